@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash map in the style of SwissTable. Entries live in one flat slot array next to an array of
+// control bytes, one per slot: empty, deleted, or the low 7 bits of the hash of a full slot. A lookup loads the
+// control bytes of a group of 16 slots at once (one SSE2 compare when available) and only compares keys of the
+// slots whose tag matches, so a miss usually touches no entry at all and a hit touches one. Inserts don't allocate
+// until the table grows, and erase leaves the other entries in place.
+//
+// Erase only invalidates iterators to the erased entry; inserts invalidate every iterator when the table grows.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap {
+   public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+
+    template <bool IsConst>
+    class Iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+        using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+
+        Iterator() = default;
+        // const_iterator from iterator
+        template <bool OtherConst, typename = std::enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other) : m_ctrl(other.m_ctrl), m_slot(other.m_slot), m_end(other.m_end) {}
+
+        reference operator*() const { return *m_slot; }
+        pointer operator->() const { return m_slot; }
+
+        Iterator& operator++() {
+            ++m_ctrl;
+            ++m_slot;
+            skipFree();
+            return *this;
+        }
+        Iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const Iterator& other) const { return m_slot == other.m_slot; }
+        bool operator!=(const Iterator& other) const { return m_slot != other.m_slot; }
+
+       private:
+        friend class FlatHashMap;
+        template <bool>
+        friend class Iterator;
+
+        Iterator(const int8_t* ctrl, pointer slot, const int8_t* end) : m_ctrl(ctrl), m_slot(slot), m_end(end) {}
+
+        void skipFree() {
+            while (m_ctrl != m_end && *m_ctrl < 0) {
+                ++m_ctrl;
+                ++m_slot;
+            }
+        }
+
+        const int8_t* m_ctrl = nullptr;
+        pointer m_slot = nullptr;
+        const int8_t* m_end = nullptr;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+    ~FlatHashMap() { destroy(); }
+
+    FlatHashMap(const FlatHashMap& other) {
+        reserve(other.m_size);
+        for (const auto& entry : other) {
+            insertUnique(hashOf(entry.first), entry.first, entry.second);
+        }
+    }
+    FlatHashMap(FlatHashMap&& other) noexcept { swap(other); }
+    FlatHashMap& operator=(FlatHashMap other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(FlatHashMap& other) noexcept {
+        std::swap(m_ctrl, other.m_ctrl);
+        std::swap(m_slots, other.m_slots);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_size, other.m_size);
+        std::swap(m_growthLeft, other.m_growthLeft);
+    }
+
+    iterator begin() { return makeIterator(0); }
+    iterator end() { return iterator(nullptr, m_slots + m_capacity, nullptr); }
+    const_iterator begin() const { return const_cast<FlatHashMap*>(this)->begin(); }
+    const_iterator end() const { return const_cast<FlatHashMap*>(this)->end(); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_t capacity() const { return m_capacity; }
+
+    iterator find(const Key& key) {
+        const auto index = findIndex(hashOf(key), key);
+        return index == NOT_FOUND ? end() : iterator(m_ctrl + index, m_slots + index, m_ctrl + m_capacity);
+    }
+    const_iterator find(const Key& key) const { return const_cast<FlatHashMap*>(this)->find(key); }
+
+    size_t count(const Key& key) const { return findIndex(hashOf(key), key) == NOT_FOUND ? 0 : 1; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        const auto hash = hashOf(key);
+        const auto index = findIndex(hash, key);
+        if (index != NOT_FOUND) {
+            return {iterator(m_ctrl + index, m_slots + index, m_ctrl + m_capacity), false};
+        }
+        const auto inserted = insertUnique(hash, key, std::forward<Args>(args)...);
+        return {iterator(m_ctrl + inserted, m_slots + inserted, m_ctrl + m_capacity), true};
+    }
+
+    template <typename V>
+    std::pair<iterator, bool> emplace(const Key& key, V&& value) {
+        return try_emplace(key, std::forward<V>(value));
+    }
+
+    Value& operator[](const Key& key) { return try_emplace(key).first->second; }
+
+    void erase(const_iterator it) { eraseIndex(static_cast<size_t>(it.m_slot - m_slots)); }
+
+    size_t erase(const Key& key) {
+        const auto index = findIndex(hashOf(key), key);
+        if (index == NOT_FOUND) {
+            return 0;
+        }
+        eraseIndex(index);
+        return 1;
+    }
+
+    void clear() {
+        FlatHashMap empty;
+        swap(empty);
+    }
+
+    // makes room for count entries without growing
+    void reserve(size_t count) {
+        if (count > maxSizeFor(m_capacity)) {
+            rehash(capacityFor(count));
+        }
+    }
+
+   private:
+    static constexpr size_t GROUP_WIDTH = 16;
+    static constexpr size_t MIN_CAPACITY = GROUP_WIDTH;
+    static constexpr size_t NOT_FOUND = ~size_t{0};
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    // Bit i of a mask is set when slot i of the group matches. The SSE2 and portable paths build the same masks.
+    struct Group {
+        explicit Group(const int8_t* ctrl) {
+#ifdef __SSE2__
+            m_ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+            std::memcpy(m_ctrl, ctrl, GROUP_WIDTH);
+#endif
+        }
+
+        uint32_t match(int8_t tag) const {
+#ifdef __SSE2__
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8(tag))));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; i++) {
+                mask |= uint32_t{m_ctrl[i] == tag} << i;
+            }
+            return mask;
+#endif
+        }
+
+        uint32_t matchEmpty() const { return match(EMPTY); }
+
+        // empty and deleted control bytes are the negative ones
+        uint32_t matchFree() const {
+#ifdef __SSE2__
+            return static_cast<uint32_t>(_mm_movemask_epi8(m_ctrl));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; i++) {
+                mask |= uint32_t{m_ctrl[i] < 0} << i;
+            }
+            return mask;
+#endif
+        }
+
+#ifdef __SSE2__
+        __m128i m_ctrl;
+#else
+        int8_t m_ctrl[GROUP_WIDTH];
+#endif
+    };
+
+    // Std hashes of integers are the identity, so those are mixed before their low bits become tags and their high
+    // bits slot positions; string hashes are already well mixed
+    size_t hashOf(const Key& key) const {
+        const size_t hash = Hash{}(key);
+        if constexpr (std::is_integral_v<Key>) {
+            const auto product = static_cast<unsigned __int128>(hash) * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(product) ^ static_cast<size_t>(product >> 64);
+        } else {
+            return hash;
+        }
+    }
+    static int8_t tagOf(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+    static size_t positionOf(size_t hash) { return hash >> 7; }
+
+    // at most 7/8 of the slots are used, so every probe sequence reaches an empty slot
+    static size_t maxSizeFor(size_t capacity) { return capacity - capacity / 8; }
+    static size_t capacityFor(size_t count) {
+        size_t capacity = MIN_CAPACITY;
+        while (maxSizeFor(capacity) < count) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // The probe sequence visits groups starting at triangular offsets from the home position, which covers the
+    // whole power-of-two table. Groups can start at any slot: the control bytes of the first GROUP_WIDTH slots are
+    // mirrored after the last one, so a group load never wraps. Stops at the first group visitGroup returns true for.
+    template <typename F>
+    void probe(size_t hash, F&& visitGroup) const {
+        const size_t mask = m_capacity - 1;
+        size_t position = positionOf(hash) & mask;
+        for (size_t step = GROUP_WIDTH; !visitGroup(position, Group(m_ctrl + position)); step += GROUP_WIDTH) {
+            position = (position + step) & mask;
+        }
+    }
+
+    size_t findIndex(size_t hash, const Key& key) const {
+        size_t found = NOT_FOUND;
+        if (m_size == 0) {
+            return found;
+        }
+        probe(hash, [&](size_t position, const Group& group) {
+            for (auto matches = group.match(tagOf(hash)); matches != 0; matches &= matches - 1) {
+                const auto index = (position + static_cast<size_t>(__builtin_ctz(matches))) & (m_capacity - 1);
+                if (KeyEqual{}(m_slots[index].first, key)) {
+                    found = index;
+                    return true;
+                }
+            }
+            // an empty slot ends the probe sequence of every key
+            return group.matchEmpty() != 0;
+        });
+        return found;
+    }
+
+    size_t findFreeIndex(size_t hash) const {
+        size_t found = NOT_FOUND;
+        probe(hash, [&](size_t position, const Group& group) {
+            const auto free = group.matchFree();
+            if (free == 0) {
+                return false;
+            }
+            found = (position + static_cast<size_t>(__builtin_ctz(free))) & (m_capacity - 1);
+            return true;
+        });
+        return found;
+    }
+
+    void setCtrl(size_t index, int8_t ctrl) {
+        m_ctrl[index] = ctrl;
+        if (index < GROUP_WIDTH) {
+            m_ctrl[m_capacity + index] = ctrl;
+        }
+    }
+
+    // key must not be in the map
+    template <typename... Args>
+    size_t insertUnique(size_t hash, const Key& key, Args&&... args) {
+        if (m_capacity == 0) {
+            rehash(MIN_CAPACITY);
+        }
+        auto index = findFreeIndex(hash);
+        if (m_growthLeft == 0 && m_ctrl[index] == EMPTY) {
+            // mostly tombstones: clean them up in place, otherwise grow
+            rehash(m_size + 1 > maxSizeFor(m_capacity) / 2 ? m_capacity * 2 : m_capacity);
+            index = findFreeIndex(hash);
+        }
+        m_growthLeft -= m_ctrl[index] == EMPTY;
+        new (m_slots + index) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                                         std::forward_as_tuple(std::forward<Args>(args)...));
+        setCtrl(index, tagOf(hash));
+        m_size++;
+        return index;
+    }
+
+    void eraseIndex(size_t index) {
+        m_slots[index].~value_type();
+        m_size--;
+        // A slot can go back to empty unless some probe window covering it was entirely used: a lookup may have
+        // probed past it then, and must keep doing so.
+        const auto emptyBefore = Group(m_ctrl + ((index - GROUP_WIDTH) & (m_capacity - 1))).matchEmpty();
+        const auto emptyAfter = Group(m_ctrl + index).matchEmpty();
+        const auto usedBefore = emptyBefore == 0 ? GROUP_WIDTH : static_cast<size_t>(__builtin_clz(emptyBefore)) - 16;
+        const auto usedAfter = emptyAfter == 0 ? GROUP_WIDTH : static_cast<size_t>(__builtin_ctz(emptyAfter));
+        if (usedBefore + usedAfter < GROUP_WIDTH) {
+            setCtrl(index, EMPTY);
+            m_growthLeft++;
+        } else {
+            setCtrl(index, DELETED);
+        }
+    }
+
+    void rehash(size_t capacity) {
+        auto* const oldCtrl = m_ctrl;
+        auto* const oldSlots = m_slots;
+        const auto oldCapacity = m_capacity;
+
+        m_capacity = capacity;
+        m_ctrl = new int8_t[capacity + GROUP_WIDTH];
+        std::memset(m_ctrl, EMPTY, capacity + GROUP_WIDTH);
+        m_slots = std::allocator<value_type>().allocate(capacity);
+        m_growthLeft = maxSizeFor(capacity) - m_size;
+
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldCtrl[i] >= 0) {
+                const auto hash = hashOf(oldSlots[i].first);
+                const auto index = findFreeIndex(hash);
+                new (m_slots + index) value_type(std::move(oldSlots[i]));
+                setCtrl(index, tagOf(hash));
+                oldSlots[i].~value_type();
+            }
+        }
+        delete[] oldCtrl;
+        if (oldSlots) {
+            std::allocator<value_type>().deallocate(oldSlots, oldCapacity);
+        }
+    }
+
+    void destroy() {
+        for (size_t i = 0; i < m_capacity; i++) {
+            if (m_ctrl[i] >= 0) {
+                m_slots[i].~value_type();
+            }
+        }
+        delete[] m_ctrl;
+        if (m_slots) {
+            std::allocator<value_type>().deallocate(m_slots, m_capacity);
+        }
+    }
+
+    iterator makeIterator(size_t index) {
+        iterator it(m_ctrl + index, m_slots + index, m_ctrl + m_capacity);
+        if (m_capacity > 0) {
+            it.skipFree();
+        }
+        return it;
+    }
+
+    int8_t* m_ctrl = nullptr;
+    value_type* m_slots = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+    size_t m_growthLeft = 0;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "OrderView.h"
+#include "SymbolTable.h"
+
+// Open qty of one security netted per company, and the matching size derived from it.
+//
+// Orders can be split across counterparties, so the matchable qty only depends on the per-company totals: a buy can
+// cross any sell from another company. By max-flow/min-cut the answer is the smallest of the total buy qty, the total
+// sell qty and, for every company, the qty left once that company's own buys and sells are taken out of the book:
+// min(buy, sell, buy + sell - max over companies of (company buy + company sell)).
+//
+// The per-company qtys live in contiguous arrays indexed by a dense company slot, so the matching size is a single
+// branch-free max reduction over one array that the compiler can vectorize. SlotMap maps a company symbol to its slot.
+template <typename SlotMap>
+class NettingEngine {
+   public:
+    void add(SymbolId company, OrderSide side, uint64_t qty) {
+        auto [slotIt, inserted] = m_slots.try_emplace(company, static_cast<uint32_t>(m_companies.size()));
+        if (inserted) {
+            m_companies.push_back(company);
+            m_qty[0].push_back(0);
+            m_qty[1].push_back(0);
+            m_bothSidesQty.push_back(0);
+            m_orderCount.push_back(0);
+        }
+        const auto slot = slotIt->second;
+        m_qty[static_cast<size_t>(side)][slot] += qty;
+        m_bothSidesQty[slot] += qty;
+        m_orderCount[slot]++;
+        m_totalQty[static_cast<size_t>(side)] += qty;
+    }
+
+    // the company must have an order of this qty on this side
+    void remove(SymbolId company, OrderSide side, uint64_t qty) {
+        const auto slotIt = m_slots.find(company);
+        const auto slot = slotIt->second;
+        m_totalQty[static_cast<size_t>(side)] -= qty;
+        if (--m_orderCount[slot] > 0) {
+            m_qty[static_cast<size_t>(side)][slot] -= qty;
+            m_bothSidesQty[slot] -= qty;
+            return;
+        }
+
+        // the company's last order: swap the last slot into its place
+        m_slots.erase(slotIt);
+        const auto last = m_companies.size() - 1;
+        if (slot != last) {
+            m_companies[slot] = m_companies[last];
+            m_qty[0][slot] = m_qty[0][last];
+            m_qty[1][slot] = m_qty[1][last];
+            m_bothSidesQty[slot] = m_bothSidesQty[last];
+            m_orderCount[slot] = m_orderCount[last];
+            m_slots.find(m_companies[slot])->second = slot;
+        }
+        m_companies.pop_back();
+        m_qty[0].pop_back();
+        m_qty[1].pop_back();
+        m_bothSidesQty.pop_back();
+        m_orderCount.pop_back();
+    }
+
+    // an order of the company moves from oldQty to newQty
+    void changeQty(SymbolId company, OrderSide side, uint64_t oldQty, uint64_t newQty) {
+        const auto slot = m_slots.find(company)->second;
+        auto& qty = m_qty[static_cast<size_t>(side)][slot];
+        qty = qty - oldQty + newQty;
+        m_bothSidesQty[slot] = m_bothSidesQty[slot] - oldQty + newQty;
+        m_totalQty[static_cast<size_t>(side)] = m_totalQty[static_cast<size_t>(side)] - oldQty + newQty;
+    }
+
+    unsigned int matchingSize() const {
+        const uint64_t totalBuy = m_totalQty[static_cast<size_t>(OrderSide::BUY)];
+        const uint64_t totalSell = m_totalQty[static_cast<size_t>(OrderSide::SELL)];
+
+        uint64_t largestCompanyQty = 0;
+        for (const auto qty : m_bothSidesQty) {
+            largestCompanyQty = std::max(largestCompanyQty, qty);
+        }
+
+        const uint64_t matchingSize = std::min({totalBuy, totalSell, totalBuy + totalSell - largestCompanyQty});
+        return static_cast<unsigned int>(std::min<uint64_t>(matchingSize, std::numeric_limits<unsigned int>::max()));
+    }
+
+    bool empty() const { return m_companies.empty(); }
+    size_t companyCount() const { return m_companies.size(); }
+    uint64_t totalQty(OrderSide side) const { return m_totalQty[static_cast<size_t>(side)]; }
+
+    // open qty of the company on this side, 0 if it has no order
+    uint64_t companyQty(SymbolId company, OrderSide side) const {
+        const auto slotIt = m_slots.find(company);
+        return slotIt == m_slots.end() ? 0 : m_qty[static_cast<size_t>(side)][slotIt->second];
+    }
+
+   private:
+    SlotMap m_slots;
+    // indexed by slot
+    std::vector<SymbolId> m_companies;
+    std::array<std::vector<uint64_t>, SIDE_SIZE> m_qty;
+    std::vector<uint64_t> m_bothSidesQty;
+    std::vector<uint32_t> m_orderCount;
+    std::array<uint64_t, SIDE_SIZE> m_totalQty{};
+};
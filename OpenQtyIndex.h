@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OrderView.h"
+
+// Open qty of every (owner, security id) pair for one kind of owner, users or companies. A single writer (the cache,
+// under its exclusive lock) keeps it up to date while any number of readers query it without taking any lock.
+//
+// Entries are never removed or moved: the hash table only holds pointers to them, and a grown table is published
+// with one atomic store. Tables replaced by a larger one are kept until the index is destroyed, since a reader may
+// still be probing them; that is less than the size of the live table. A reader sees every counter as of some recent
+// write, but may observe a mass cancel part-way through.
+class OpenQtyIndex {
+   public:
+    struct Counters {
+        std::array<std::atomic<uint64_t>, SIDE_SIZE> qty{};
+
+        // writer only
+        void add(OrderSide side, uint64_t qty) { change(side, 0, qty); }
+        void subtract(OrderSide side, uint64_t qty) { change(side, qty, 0); }
+        // a single store, so readers never see an amend half applied
+        void change(OrderSide side, uint64_t oldQty, uint64_t newQty) {
+            auto& sideQty = this->qty[static_cast<size_t>(side)];
+            sideQty.store(sideQty.load(std::memory_order_relaxed) - oldQty + newQty, std::memory_order_relaxed);
+        }
+    };
+
+    OpenQtyIndex() { publish(std::make_unique<Table>(MIN_CAPACITY)); }
+
+    OpenQtyIndex(const OpenQtyIndex&) = delete;
+    OpenQtyIndex& operator=(const OpenQtyIndex&) = delete;
+
+    // Writer only: the counters of the pair, created at 0 the first time it is seen. They stay at the same address
+    // for the lifetime of the index, so the writer can keep a pointer to them.
+    Counters& counters(std::string_view owner, std::string_view securityId) {
+        const auto hash = hashOf(owner, securityId);
+        const Table* table = m_table.load(std::memory_order_relaxed);
+        size_t slot = hash & table->mask;
+        for (Entry* entry; (entry = table->slots[slot].load(std::memory_order_relaxed)) != nullptr;
+             slot = (slot + 1) & table->mask) {
+            if (entry->matches(hash, owner, securityId)) {
+                return entry->counters;
+            }
+        }
+
+        auto& entry = m_entries.emplace_back(hash, owner, securityId);
+        if ((m_entries.size() + 1) * 2 > table->mask + 1) {
+            grow();
+        } else {
+            table->slots[slot].store(&entry, std::memory_order_release);
+        }
+        return entry.counters;
+    }
+
+    // Any thread: the open qty of the owner's orders on one side of the security, 0 if it never had one
+    uint64_t openQty(std::string_view owner, std::string_view securityId, OrderSide side) const {
+        const auto hash = hashOf(owner, securityId);
+        const Table* table = m_table.load(std::memory_order_acquire);
+        for (size_t slot = hash & table->mask;; slot = (slot + 1) & table->mask) {
+            Entry* entry = table->slots[slot].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return 0;
+            }
+            if (entry->matches(hash, owner, securityId)) {
+                return entry->counters.qty[static_cast<size_t>(side)].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Writer only: zeroes every counter, keeping the entries so pointers to them stay valid
+    void reset() {
+        for (auto& entry : m_entries) {
+            for (auto& qty : entry.counters.qty) {
+                qty.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+   private:
+    static constexpr size_t MIN_CAPACITY = 64;
+
+    struct Entry {
+        Entry(uint64_t hash, std::string_view owner, std::string_view securityId)
+            : hash(hash), owner(owner), securityId(securityId) {}
+
+        bool matches(uint64_t otherHash, std::string_view otherOwner, std::string_view otherSecurityId) const {
+            return hash == otherHash && owner == otherOwner && securityId == otherSecurityId;
+        }
+
+        const uint64_t hash;
+        const std::string owner;
+        const std::string securityId;
+        Counters counters;
+    };
+
+    // linear probing, at most half full
+    struct Table {
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Entry*>[capacity]) {
+            for (size_t i = 0; i < capacity; i++) {
+                slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        void insert(Entry& entry) {
+            size_t slot = entry.hash & mask;
+            while (slots[slot].load(std::memory_order_relaxed) != nullptr) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot].store(&entry, std::memory_order_relaxed);
+        }
+
+        const size_t mask;
+        const std::unique_ptr<std::atomic<Entry*>[]> slots;
+    };
+
+    static uint64_t hashOf(std::string_view owner, std::string_view securityId) {
+        const uint64_t ownerHash = std::hash<std::string_view>{}(owner);
+        return ownerHash ^ (std::hash<std::string_view>{}(securityId) + 0x9e3779b97f4a7c15ULL + (ownerHash << 6) +
+                            (ownerHash >> 2));
+    }
+
+    // rebuilds every entry, the newest included, into a table twice the size
+    void grow() {
+        auto table = std::make_unique<Table>((m_table.load(std::memory_order_relaxed)->mask + 1) * 2);
+        for (auto& entry : m_entries) {
+            table->insert(entry);
+        }
+        publish(std::move(table));
+    }
+
+    void publish(std::unique_ptr<Table> table) {
+        m_table.store(table.get(), std::memory_order_release);
+        m_tables.push_back(std::move(table));
+    }
+
+    // a deque never moves its elements
+    std::deque<Entry> m_entries;
+    std::atomic<const Table*> m_table{nullptr};
+    // the live table is the last one
+    std::vector<std::unique_ptr<Table>> m_tables;
+};
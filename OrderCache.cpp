@@ -1,221 +1,676 @@
 #include "OrderCache.h"
 
 #include <algorithm>
-
-size_t OrderCache::toOrderSide(const std::string& sideStr) {
-    std::string lowerCaseSideStr;
-    std::transform(sideStr.begin(), sideStr.end(), std::back_inserter(lowerCaseSideStr), ::tolower);
-
-    if (lowerCaseSideStr == "buy") return static_cast<size_t>(OrderSide::BUY);
-    if (lowerCaseSideStr == "sell")
-        return static_cast<size_t>(OrderSide::SELL);
+#include <cctype>
+
+#include "ParallelFor.h"
+
+template <typename Locking, typename Maps, typename Stats>
+OrderSide BasicOrderCache<Locking, Maps, Stats>::toOrderSide(std::string_view sideStr) {
+    // compares in place instead of building a lower-cased copy
+    auto equalsIgnoreCase = [&](std::string_view lowerCase) {
+        return sideStr.size() == lowerCase.size() &&
+               std::equal(sideStr.begin(), sideStr.end(), lowerCase.begin(),
+                          [](char c, char lower) { return std::tolower(static_cast<unsigned char>(c)) == lower; });
+    };
+
+    if (equalsIgnoreCase("buy")) return OrderSide::BUY;
+    if (equalsIgnoreCase("sell"))
+        return OrderSide::SELL;
     else
         throw std::exception();
 }
 
-void OrderCache::addOrder(Order order) {
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+const std::string& BasicOrderCache<Locking, Maps, Stats>::sideName(OrderSide side) {
+    static const std::array<std::string, SIDE_SIZE> names = {"Buy", "Sell"};
+    return names[static_cast<size_t>(side)];
+}
+
+template <typename Locking, typename Maps, typename Stats>
+unsigned int BasicOrderCache<Locking, Maps, Stats>::matchingSize(const SecurityBook& book) {
+    return book.netting.matchingSize();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::addToAggregates(SecurityBook& book, const OrderRecord& record) {
+    book.netting.add(record.company, record.side, record.qty);
+    openQtyCounters(book.userOpenQty, m_userOpenQty, m_users, record.user, record.securityId)
+        .add(record.side, record.qty);
+    openQtyCounters(book.companyOpenQty, m_companyOpenQty, m_companies, record.company, record.securityId)
+        .add(record.side, record.qty);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::removeFromAggregates(SecurityBook& book, const OrderRecord& record) {
+    book.netting.remove(record.company, record.side, record.qty);
+    book.userOpenQty.find(record.user)->second->subtract(record.side, record.qty);
+    book.companyOpenQty.find(record.company)->second->subtract(record.side, record.qty);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::changeAggregateQty(SecurityBook& book, const OrderRecord& record,
+                                                               unsigned int newQty) {
+    book.netting.changeQty(record.company, record.side, record.qty, newQty);
+    book.userOpenQty.find(record.user)->second->change(record.side, record.qty, newQty);
+    book.companyOpenQty.find(record.company)->second->change(record.side, record.qty, newQty);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+OpenQtyIndex::Counters& BasicOrderCache<Locking, Maps, Stats>::openQtyCounters(
+    HashMap<SymbolId, OpenQtyIndex::Counters*>& byOwner, OpenQtyIndex& index, const SymbolTable& owners,
+    SymbolId owner, SymbolId securityId) {
+    auto [countersIt, inserted] = byOwner.try_emplace(owner, nullptr);
+    if (inserted) {
+        countersIt->second = &index.counters(owners.name(owner), m_securities.name(securityId));
+    }
+    return *countersIt->second;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::removeFromList(std::vector<OrderHandle>& handles, uint32_t slot,
+                                                           uint32_t OrderRecord::*slotField) {
+    const auto movedHandle = handles.back();
+    handles[slot] = movedHandle;
+    m_orderPool[movedHandle].*slotField = slot;
+    handles.pop_back();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::eraseOrder(OrderHandle handle) {
+    if (publishingLocked()) {
+        collectLocked(OrderCacheEvent::Type::ORDER_CANCELLED, handle);
+    }
+    const auto& record = m_orderPool[handle];
+
+    auto& book = m_securityIndex[record.securityId];
+    book.orders[static_cast<size_t>(record.side)].erase({record.qty, handle});
+    removeFromAggregates(book, record);
+    removeFromList(m_userIndex[record.user], record.userSlot, &OrderRecord::userSlot);
+    m_orderMap.erase(m_orderPool.orderId(handle));
+    m_orderPool.release(handle);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::collectLocked(OrderCacheEvent::Type type, OrderHandle handle) {
+    const auto& record = m_orderPool[handle];
+    auto& event = m_pendingEvents.emplace_back();
+    event.type = type;
+    event.orderId = m_orderPool.orderId(handle);
+    event.securityId = m_securities.name(record.securityId);
+    event.side = record.side;
+    event.qty = record.qty;
+    event.user = m_users.name(record.user);
+    event.company = m_companies.name(record.company);
+
+    auto& book = m_securityIndex[record.securityId];
+    if (!book.changed) {
+        book.changed = true;
+        m_changedSecurities.push_back(record.securityId);
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::collectBatchLocked(size_t firstEvent, OrderCacheEvent batch) {
+    // nothing matched
+    if (firstEvent == m_pendingEvents.size()) {
+        return;
+    }
+    batch.orderIds.reserve(m_pendingEvents.size() - firstEvent);
+    for (size_t i = firstEvent; i < m_pendingEvents.size(); i++) {
+        batch.orderIds.push_back(std::move(m_pendingEvents[i].orderId));
+    }
+    m_pendingEvents.resize(firstEvent);
+    m_pendingEvents.push_back(std::move(batch));
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::publishLocked() {
+    if (!publishingLocked()) {
+        return;
+    }
+    // subscriptions nobody holds anymore
+    m_subscriptions.erase(std::remove_if(m_subscriptions.begin(), m_subscriptions.end(),
+                                         [](const auto& subscription) { return subscription.use_count() == 1; }),
+                          m_subscriptions.end());
+
+    for (const auto& event : m_pendingEvents) {
+        for (const auto& subscription : m_subscriptions) {
+            subscription->publish(event);
+        }
+    }
+    for (const auto secId : m_changedSecurities) {
+        auto& book = m_securityIndex[secId];
+        book.changed = false;
+        const auto size = matchingSize(book);
+        if (size == book.publishedMatchingSize) {
+            continue;
+        }
+        book.publishedMatchingSize = size;
+        for (const auto& subscription : m_subscriptions) {
+            subscription->publishMatchingSize(secId, m_securities.name(secId), size);
+        }
+    }
+    m_pendingEvents.clear();
+    m_changedSecurities.clear();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::resetPublishedLocked() {
+    for (auto& book : m_securityIndex) {
+        book.publishedMatchingSize = matchingSize(book);
+        book.changed = false;
+    }
+    m_pendingEvents.clear();
+    m_changedSecurities.clear();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+std::shared_ptr<OrderCacheSubscription> BasicOrderCache<Locking, Maps, Stats>::subscribe(size_t capacity) {
+    auto subscription = std::make_shared<OrderCacheSubscription>(capacity);
 
-    auto orderPtr = std::make_shared<Order>(std::move(order));
-    m_orderMap[orderPtr->orderId()] = orderPtr;
-    m_userIndex[orderPtr->user()][orderPtr->orderId()] = orderPtr;
-    m_securityIndex[orderPtr->securityId()][toOrderSide(orderPtr->side())][orderPtr->orderId()] = orderPtr;
+    ExclusiveLock lck(mtx, m_stats);
+
+    // nothing was published while there was no subscriber
+    if (!publishingLocked()) {
+        resetPublishedLocked();
+    }
+    m_subscriptions.push_back(subscription);
+    return subscription;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::unsubscribe(const std::shared_ptr<OrderCacheSubscription>& subscription) {
+    ExclusiveLock lck(mtx, m_stats);
+
+    m_subscriptions.erase(std::remove(m_subscriptions.begin(), m_subscriptions.end(), subscription),
+                          m_subscriptions.end());
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::addOrderLocked(const OrderView& order) {
+    journalLocked(JournalEntry{JournalEntry::Type::ADD, order.orderId, order.securityId, order.user, order.company,
+                               order.side, order.qty});
+
+    // a reused order id replaces the resting order
+    const auto& existingIt = m_orderMap.find(order.orderId);
+    if (existingIt != m_orderMap.end()) {
+        eraseOrder(existingIt->second);
+    }
+
+    insertOrderLocked(order.orderId, m_securities.intern(order.securityId), m_users.intern(order.user),
+                      m_companies.intern(order.company), order.qty, order.side);
 }
 
-void OrderCache::cancelOrder(const std::string& orderId) {
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::insertOrderLocked(std::string_view orderId, SymbolId securityId,
+                                                              SymbolId userId, SymbolId companyId, unsigned int qty,
+                                                              OrderSide side) {
+    if (securityId >= m_securityIndex.size()) {
+        m_securityIndex.resize(securityId + 1);
+    }
+    if (userId >= m_userIndex.size()) {
+        m_userIndex.resize(userId + 1);
+    }
+
+    auto& book = m_securityIndex[securityId];
+    auto& userOrders = m_userIndex[userId];
+
+    const auto handle = m_orderPool.allocate(
+        orderId, OrderRecord{securityId, userId, companyId, qty, side, static_cast<uint32_t>(userOrders.size())});
+    book.orders[static_cast<size_t>(side)].emplace(qty, handle);
+    userOrders.push_back(handle);
+    addToAggregates(book, m_orderPool[handle]);
+    m_orderMap.emplace(m_orderPool.orderId(handle), handle);
+    if (publishingLocked()) {
+        collectLocked(OrderCacheEvent::Type::ORDER_ADDED, handle);
+    }
+}
 
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrderLocked(std::string_view orderId) {
     const auto& orderMapIt = m_orderMap.find(orderId);
     if (orderMapIt == m_orderMap.end()) {
         return;
     }
 
-    const auto userId = orderMapIt->second->user();
-    const auto secId = orderMapIt->second->securityId();
-    const auto orderSide = orderMapIt->second->side();
+    journalLocked(JournalEntry{JournalEntry::Type::CANCEL, orderId});
+    eraseOrder(orderMapIt->second);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::addOrder(Order order) {
+    OpTimer timer(m_stats, CacheOp::ADD_ORDER);
+    const auto side = toOrderSide(order.side());
+
+    ExclusiveLock lck(mtx, m_stats);
 
-    m_userIndex.at(userId).erase(orderId);
-    m_securityIndex.at(secId).at(toOrderSide(orderSide)).erase(orderId);
-    m_orderMap.erase(orderId);
+    addOrderLocked(toOrderView(order, side));
+    publishLocked();
 }
 
-void OrderCache::cancelOrdersForUser(const std::string& user) {
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::addOrders(std::vector<Order> orders) {
+    OpTimer timer(m_stats, CacheOp::ADD_ORDERS);
+    std::vector<OrderSide> sides;
+    sides.reserve(orders.size());
+    for (const auto& order : orders) {
+        sides.push_back(toOrderSide(order.side()));
+    }
 
-    const auto& userOrderMapIt = m_userIndex.find(user);
-    if (userOrderMapIt == m_userIndex.end()) {
-        return;
+    ExclusiveLock lck(mtx, m_stats);
+
+    m_orderMap.reserve(m_orderMap.size() + orders.size());
+    m_orderPool.reserve(m_orderPool.size() + orders.size());
+    for (size_t i = 0; i < orders.size(); i++) {
+        addOrderLocked(toOrderView(orders[i], sides[i]));
     }
+    publishLocked();
+}
 
-    for (const auto& [orderId, orderWeakPtr] : userOrderMapIt->second) {
-        auto orderSharedPtr = orderWeakPtr.lock();
-        if (orderSharedPtr) {
-            m_securityIndex.at(orderSharedPtr->securityId()).at(toOrderSide(orderSharedPtr->side())).erase(orderId);
-        }
-        m_orderMap.erase(orderId);
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrder(std::string_view orderId) {
+    OpTimer timer(m_stats, CacheOp::CANCEL_ORDER);
+    ExclusiveLock lck(mtx, m_stats);
+
+    cancelOrderLocked(orderId);
+    publishLocked();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrders(const std::vector<std::string_view>& orderIds) {
+    OpTimer timer(m_stats, CacheOp::CANCEL_ORDERS);
+    ExclusiveLock lck(mtx, m_stats);
+
+    for (const auto& orderId : orderIds) {
+        cancelOrderLocked(orderId);
+    }
+    publishLocked();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+unsigned int BasicOrderCache<Locking, Maps, Stats>::setOrderQtyLocked(OrderHandle handle, unsigned int newQty) {
+    const auto orderId = m_orderPool.orderId(handle);
+    if (newQty == 0) {
+        journalLocked(JournalEntry{JournalEntry::Type::CANCEL, orderId});
+        eraseOrder(handle);
+        return 0;
+    }
+
+    auto& record = m_orderPool[handle];
+    if (newQty == record.qty) {
+        return newQty;
+    }
+    JournalEntry entry{JournalEntry::Type::AMEND_QTY, orderId};
+    entry.qty = newQty;
+    journalLocked(entry);
+
+    // re-key the qty index entry by moving its node, which allocates nothing
+    auto& book = m_securityIndex[record.securityId];
+    auto& ordersBySide = book.orders[static_cast<size_t>(record.side)];
+    auto node = ordersBySide.extract({record.qty, handle});
+    node.value().first = newQty;
+    ordersBySide.insert(std::move(node));
+
+    changeAggregateQty(book, record, newQty);
+    record.qty = newQty;
+    if (publishingLocked()) {
+        collectLocked(OrderCacheEvent::Type::ORDER_QTY_CHANGED, handle);
+    }
+    return newQty;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::amendOrderQty(std::string_view orderId, unsigned int newQty) {
+    amendOrderQty(orderId, newQty, nullptr);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::amendOrderQty(std::string_view orderId, unsigned int newQty,
+                                                          unsigned int* restingQty) {
+    OpTimer timer(m_stats, CacheOp::AMEND_ORDER_QTY);
+    ExclusiveLock lck(mtx, m_stats);
+
+    const auto& orderMapIt = m_orderMap.find(orderId);
+    const auto qty = orderMapIt == m_orderMap.end() ? 0 : setOrderQtyLocked(orderMapIt->second, newQty);
+    publishLocked();
+    if (restingQty) {
+        *restingQty = qty;
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::reduceOrderQty(std::string_view orderId, unsigned int delta) {
+    reduceOrderQty(orderId, delta, nullptr);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::reduceOrderQty(std::string_view orderId, unsigned int delta,
+                                                           unsigned int* restingQty) {
+    OpTimer timer(m_stats, CacheOp::REDUCE_ORDER_QTY);
+    ExclusiveLock lck(mtx, m_stats);
+
+    unsigned int qty = 0;
+    const auto& orderMapIt = m_orderMap.find(orderId);
+    if (orderMapIt != m_orderMap.end()) {
+        const auto handle = orderMapIt->second;
+        const auto currentQty = m_orderPool[handle].qty;
+        qty = setOrderQtyLocked(handle, delta < currentQty ? currentQty - delta : 0);
     }
-    m_userIndex.erase(user);
+    publishLocked();
+    if (restingQty) {
+        *restingQty = qty;
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForUser(std::string_view user) {
+    cancelOrdersForUser(user, nullptr);
 }
 
-void OrderCache::cancelOrdersForSecIdWithMinimumQty(const std::string& securityId, unsigned int minQty) {
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForUser(std::string_view user,
+                                                                std::vector<std::string>* cancelledOrderIds) {
+    OpTimer timer(m_stats, CacheOp::CANCEL_ORDERS_FOR_USER);
+    ExclusiveLock lck(mtx, m_stats);
+
+    cancelOrdersForUserLocked(user, cancelledOrderIds);
+    publishLocked();
+}
 
-    const auto& securityOrderMapIt = m_securityIndex.find(securityId);
-    if (securityOrderMapIt == m_securityIndex.end()) {
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForUserLocked(std::string_view user,
+                                                                      std::vector<std::string>* cancelledOrderIds) {
+    SymbolId userId;
+    if (!m_users.find(user, userId) || m_userIndex[userId].empty()) {
         return;
     }
 
-    for (auto& ordersBySide : securityOrderMapIt->second) {
-        for (auto orderInfoIt = ordersBySide.begin(); orderInfoIt != ordersBySide.end();) {
-            auto orderPtr = orderInfoIt->second.lock();
-            if (orderPtr && orderPtr->qty() >= minQty) {
-                m_userIndex.at(orderPtr->user()).erase(orderPtr->orderId());
-                m_orderMap.erase(orderPtr->orderId());
-                orderInfoIt = ordersBySide.erase(orderInfoIt);
-            } else {
-                orderInfoIt++;
-            }
+    journalLocked(JournalEntry{JournalEntry::Type::CANCEL_USER, {}, {}, user});
+
+    // erasing the last order of the list never moves another one
+    const auto firstEvent = m_pendingEvents.size();
+    auto& userOrders = m_userIndex[userId];
+    while (!userOrders.empty()) {
+        if (cancelledOrderIds) {
+            cancelledOrderIds->emplace_back(m_orderPool.orderId(userOrders.back()));
         }
+        eraseOrder(userOrders.back());
+    }
+
+    if (publishingLocked()) {
+        OrderCacheEvent batch;
+        batch.type = OrderCacheEvent::Type::ORDERS_CANCELLED;
+        batch.user = user;
+        collectBatchLocked(firstEvent, std::move(batch));
     }
 }
 
-unsigned int OrderCache::getMatchingSizeForSecurity(const std::string& securityId) {
-    unsigned int matchingSize = 0;
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                                               unsigned int minQty) {
+    cancelOrdersForSecIdWithMinimumQty(securityId, minQty, nullptr);
+}
 
-    using CompanyName = std::string;
-    std::array<std::unordered_map<CompanyName, std::vector<std::weak_ptr<Order>>>, SIDE_SIZE> ordersByCompanies;
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForSecIdWithMinimumQty(
+    std::string_view securityId, unsigned int minQty, std::vector<std::string>* cancelledOrderIds) {
+    OpTimer timer(m_stats, CacheOp::CANCEL_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY);
+    ExclusiveLock lck(mtx, m_stats);
+
+    cancelOrdersForSecIdWithMinimumQtyLocked(securityId, minQty, cancelledOrderIds);
+    publishLocked();
+}
 
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::cancelOrdersForSecIdWithMinimumQtyLocked(
+    std::string_view securityId, unsigned int minQty, std::vector<std::string>* cancelledOrderIds) {
+    SymbolId secId;
+    if (!m_securities.find(securityId, secId)) {
+        return;
+    }
 
-    for (auto& ordersBySide : m_securityIndex[securityId]) {
-        for (auto& [_, orderWptr] : ordersBySide) {
-            auto orderPtr = orderWptr.lock();
-            if (orderPtr) {
-                ordersByCompanies[toOrderSide(orderPtr->side())][orderPtr->company()].emplace_back(orderPtr);
+    JournalEntry entry{JournalEntry::Type::CANCEL_SEC_ID_MIN_QTY, {}, securityId};
+    entry.qty = minQty;
+    journalLocked(entry);
+
+    const auto firstEvent = m_pendingEvents.size();
+    for (auto& ordersBySide : m_securityIndex[secId].orders) {
+        for (auto orderIt = ordersBySide.lower_bound({minQty, 0}); orderIt != ordersBySide.end();) {
+            // step past the entry first, eraseOrder removes it from the index
+            const auto handle = (orderIt++)->second;
+            if (cancelledOrderIds) {
+                cancelledOrderIds->emplace_back(m_orderPool.orderId(handle));
             }
+            eraseOrder(handle);
         }
     }
 
-    if (ordersByCompanies[static_cast<size_t>(OrderSide::BUY)].size() == 0 ||
-        ordersByCompanies[static_cast<size_t>(OrderSide::SELL)].size() == 0) {
+    if (publishingLocked()) {
+        OrderCacheEvent batch;
+        batch.type = OrderCacheEvent::Type::ORDERS_CANCELLED;
+        batch.securityId = securityId;
+        batch.qty = minQty;
+        collectBatchLocked(firstEvent, std::move(batch));
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+unsigned int BasicOrderCache<Locking, Maps, Stats>::getMatchingSizeForSecurity(std::string_view securityId) {
+    OpTimer timer(m_stats, CacheOp::GET_MATCHING_SIZE_FOR_SECURITY);
+    SharedLock lck(mtx, m_stats);
+
+    SymbolId secId;
+    if (!m_securities.find(securityId, secId)) {
         return 0;
     }
+    return matchingSize(m_securityIndex[secId]);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+uint64_t BasicOrderCache<Locking, Maps, Stats>::getOpenQtyForUser(std::string_view user, std::string_view securityId,
+                                                                  OrderSide side) const {
+    OpTimer timer(m_stats, CacheOp::GET_OPEN_QTY);
+    return m_userOpenQty.openQty(user, securityId, side);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+uint64_t BasicOrderCache<Locking, Maps, Stats>::getOpenQtyForCompany(std::string_view company,
+                                                                     std::string_view securityId,
+                                                                     OrderSide side) const {
+    OpTimer timer(m_stats, CacheOp::GET_OPEN_QTY);
+    return m_companyOpenQty.openQty(company, securityId, side);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+std::vector<SecurityMatchingSize> BasicOrderCache<Locking, Maps, Stats>::getMatchingSizesForAllSecurities(
+    size_t threadCount) const {
+    OpTimer timer(m_stats, CacheOp::GET_MATCHING_SIZES_FOR_ALL_SECURITIES);
+    // below this many securities per thread, starting a thread costs more than it saves
+    constexpr size_t MIN_SECURITIES_PER_THREAD = 2048;
+
+    SharedLock lck(mtx, m_stats);
+
+    std::vector<SecurityMatchingSize> sizes(m_securityIndex.size());
+    parallelFor(m_securityIndex.size(), MIN_SECURITIES_PER_THREAD, threadCount, [&](size_t begin, size_t end) {
+        for (size_t secId = begin; secId < end; secId++) {
+            sizes[secId] = SecurityMatchingSize{m_securities.name(static_cast<SymbolId>(secId)),
+                                                matchingSize(m_securityIndex[secId])};
+        }
+    });
 
-    std::array<std::unordered_map<CompanyName, std::pair<std::vector<std::weak_ptr<Order>>::iterator, int>>, SIDE_SIZE>
-        lastVisitedOrder;
-    for (size_t i = 0; i < SIDE_SIZE; i++) {
-        for (auto& [company, orders] : ordersByCompanies[i]) {
-            lastVisitedOrder[i][company] = std::make_pair(orders.begin(), 0);
+    // securities whose orders were all cancelled are left out
+    size_t kept = 0;
+    for (size_t secId = 0; secId < sizes.size(); secId++) {
+        if (!m_securityIndex[secId].netting.empty()) {
+            sizes[kept++] = sizes[secId];
         }
     }
+    sizes.resize(kept);
+    return sizes;
+}
 
-    auto buyCompaniesIt = ordersByCompanies[static_cast<size_t>(OrderSide::BUY)].begin();
-    auto sellCompaniesIt = ordersByCompanies[static_cast<size_t>(OrderSide::SELL)].begin();
-    auto companyBuyOrdersIt = buyCompaniesIt->second.begin();
-    auto companySellOrdersIt = sellCompaniesIt->second.begin();
-
-    auto makeValidAdvance =
-        [&](std::vector<std::weak_ptr<Order>>::iterator& it,
-            std::unordered_map<std::string, std::vector<std::weak_ptr<Order>>>::iterator& companiesIt,
-            const OrderSide& side, const std::string& otherSideCompanyName) {
-            it++;
-
-            std::decay_t<decltype(it)> notVisitedIt = {};
-            std::decay_t<decltype(companiesIt)> notVisitCompanyIt = {};
-
-            size_t rotation = 0;
-            while (companiesIt->first == otherSideCompanyName || it == companiesIt->second.end()) {
-                companiesIt++;
-                if (companiesIt == ordersByCompanies[static_cast<size_t>(side)].end()) {
-                    companiesIt = ordersByCompanies[static_cast<size_t>(side)].begin();
-                }
-                auto& lastVisitedOrderForCurrentCompany =
-                    lastVisitedOrder[static_cast<size_t>(side)].at(companiesIt->first).first;
-                if (lastVisitedOrderForCurrentCompany != companiesIt->second.end()) {
-                    notVisitCompanyIt = companiesIt;
-                    notVisitedIt = lastVisitedOrderForCurrentCompany;
-                }
-                it = lastVisitedOrderForCurrentCompany;
-
-                rotation++;
-                if (rotation == ordersByCompanies[static_cast<size_t>(side)].size()) {
-                    it = notVisitedIt;
-                    companiesIt = notVisitCompanyIt;
-                    return false;
-                }
-            }
+template <typename Locking, typename Maps, typename Stats>
+Order BasicOrderCache<Locking, Maps, Stats>::toOrder(OrderHandle handle) const {
+    const auto& record = m_orderPool[handle];
+    return Order{std::string(m_orderPool.orderId(handle)),
+                 m_securities.name(record.securityId),
+                 sideName(record.side),
+                 record.qty,
+                 m_users.name(record.user),
+                 m_companies.name(record.company)};
+}
+
+template <typename Locking, typename Maps, typename Stats>
+OrderView BasicOrderCache<Locking, Maps, Stats>::toOrderView(const Order& order, OrderSide side) {
+    return OrderView{order.orderId(), order.securityId(), side, order.qty(), order.user(), order.company()};
+}
 
-            return true;
-        };
-
-    auto buyOrderPtr = companyBuyOrdersIt->lock();
-    auto sellOrderPtr = companySellOrdersIt->lock();
-    if (buyOrderPtr && sellOrderPtr) {
-        if (buyOrderPtr->company() == sellOrderPtr->company()) {
-            if (!makeValidAdvance(companySellOrdersIt, sellCompaniesIt, OrderSide::SELL, buyCompaniesIt->first)) {
-                if (!makeValidAdvance(companyBuyOrdersIt, buyCompaniesIt, OrderSide::BUY, sellCompaniesIt->first)) {
-                    return 0;
-                }
+template <typename Locking, typename Maps, typename Stats>
+OrderView BasicOrderCache<Locking, Maps, Stats>::toOrderView(OrderHandle handle) const {
+    const auto& record = m_orderPool[handle];
+    return OrderView{m_orderPool.orderId(handle),
+                     m_securities.name(record.securityId),
+                     record.side,
+                     record.qty,
+                     m_users.name(record.user),
+                     m_companies.name(record.company)};
+}
+
+template <typename Locking, typename Maps, typename Stats>
+template <typename F>
+void BasicOrderCache<Locking, Maps, Stats>::visitLocked(const OrderFilter& filter, F&& f) const {
+    SymbolId secId = 0, userId = 0, companyId = 0;
+    if ((!filter.securityId.empty() && !m_securities.find(filter.securityId, secId)) ||
+        (!filter.user.empty() && !m_users.find(filter.user, userId)) ||
+        (!filter.company.empty() && !m_companies.find(filter.company, companyId))) {
+        return;
+    }
+
+    auto visit = [&](OrderHandle handle) {
+        const auto& record = m_orderPool[handle];
+        if ((filter.securityId.empty() || record.securityId == secId) &&
+            (filter.user.empty() || record.user == userId) &&
+            (filter.company.empty() || record.company == companyId)) {
+            f(handle);
+        }
+    };
+
+    // walk the narrowest index the filter allows
+    if (!filter.securityId.empty()) {
+        for (const auto& ordersBySide : m_securityIndex[secId].orders) {
+            for (const auto& [_, handle] : ordersBySide) {
+                visit(handle);
             }
         }
+    } else if (!filter.user.empty()) {
+        for (const auto handle : m_userIndex[userId]) {
+            visit(handle);
+        }
+    } else {
+        for (const auto& [_, handle] : m_orderMap) {
+            visit(handle);
+        }
     }
+}
 
-    int32_t qtyRemaining = 0;
-    while (true) {
-        buyOrderPtr = companyBuyOrdersIt->lock();
-        sellOrderPtr = companySellOrdersIt->lock();
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::forEachOrder(const OrderVisitor& visitor, const OrderFilter& filter) const {
+    OpTimer timer(m_stats, CacheOp::FOR_EACH_ORDER);
+    SharedLock lck(mtx, m_stats);
 
-        if (buyOrderPtr && sellOrderPtr) {
-            if (qtyRemaining == 0) {
-                qtyRemaining = buyOrderPtr->qty();
-            }
+    visitLocked(filter, [&](OrderHandle handle) { visitor(toOrderView(handle)); });
+}
 
-            int32_t qtyToBeConsidered = (qtyRemaining > 0 ? sellOrderPtr->qty() : buyOrderPtr->qty());
-            const int8_t sign = (qtyRemaining > 0 ? 1 : -1);
-
-            matchingSize += std::min(sign * qtyRemaining, qtyToBeConsidered);
-
-            if ((qtyRemaining - sign * qtyToBeConsidered) >= 0) {
-                lastVisitedOrder[static_cast<size_t>(OrderSide::BUY)].at(buyCompaniesIt->first).second =
-                    qtyRemaining - sign * qtyToBeConsidered;
-                lastVisitedOrder[static_cast<size_t>(OrderSide::SELL)].at(sellCompaniesIt->first).first++;
-                if (!makeValidAdvance(companySellOrdersIt, sellCompaniesIt, OrderSide::SELL, buyCompaniesIt->first)) {
-                    if (companySellOrdersIt == std::vector<std::weak_ptr<Order>>::iterator{} ||
-                        !makeValidAdvance(companyBuyOrdersIt, buyCompaniesIt, OrderSide::BUY, sellCompaniesIt->first)) {
-                        break;
-                    }
-                    qtyRemaining =
-                        lastVisitedOrder[static_cast<size_t>(OrderSide::SELL)][sellCompaniesIt->first].second;
-                    continue;
-                }
-            }
-            if ((qtyRemaining - sign * qtyToBeConsidered) <= 0) {
-                lastVisitedOrder[static_cast<size_t>(OrderSide::SELL)].at(sellCompaniesIt->first).second =
-                    qtyRemaining - sign * qtyToBeConsidered;
-                lastVisitedOrder[static_cast<size_t>(OrderSide::BUY)].at(buyCompaniesIt->first).first++;
-                if (!makeValidAdvance(companyBuyOrdersIt, buyCompaniesIt, OrderSide::BUY, sellCompaniesIt->first)) {
-                    if (companyBuyOrdersIt == std::vector<std::weak_ptr<Order>>::iterator{} ||
-                        !makeValidAdvance(companySellOrdersIt, sellCompaniesIt, OrderSide::SELL,
-                                          buyCompaniesIt->first)) {
-                        break;
-                    }
-                    qtyRemaining = lastVisitedOrder[static_cast<size_t>(OrderSide::BUY)][buyCompaniesIt->first].second;
-                    continue;
-                }
-            }
+template <typename Locking, typename Maps, typename Stats>
+OrderSnapshot BasicOrderCache<Locking, Maps, Stats>::snapshot(const OrderFilter& filter) const {
+    OpTimer timer(m_stats, CacheOp::SNAPSHOT);
+    OrderSnapshot snapshot;
 
-            qtyRemaining -= sign * qtyToBeConsidered;
-        }
-    }
+    SharedLock lck(mtx, m_stats);
 
-    return matchingSize;
+    if (filter.securityId.empty() && filter.user.empty() && filter.company.empty()) {
+        snapshot.reserve(m_orderMap.size());
+    }
+    visitLocked(filter, [&](OrderHandle handle) { snapshot.add(toOrderView(handle)); });
+    return snapshot;
 }
 
-std::vector<Order> OrderCache::getAllOrders() const {
-    std::lock_guard<std::mutex> lck(mtx);
+template <typename Locking, typename Maps, typename Stats>
+std::vector<Order> BasicOrderCache<Locking, Maps, Stats>::getAllOrders() const {
+    OpTimer timer(m_stats, CacheOp::GET_ALL_ORDERS);
+    SharedLock lck(mtx, m_stats);
 
     std::vector<Order> orders;
+    orders.reserve(m_orderMap.size());
     std::transform(m_orderMap.begin(), m_orderMap.end(), std::back_inserter(orders),
-                   [](const auto& pair) { return *(pair.second); });
+                   [this](const auto& pair) { return toOrder(pair.second); });
+    return orders;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+std::vector<Order> BasicOrderCache<Locking, Maps, Stats>::getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                                                          unsigned int minQty) const {
+    OpTimer timer(m_stats, CacheOp::GET_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY);
+    SharedLock lck(mtx, m_stats);
+
+    std::vector<Order> orders;
+    SymbolId secId;
+    if (!m_securities.find(securityId, secId)) {
+        return orders;
+    }
+
+    for (const auto& ordersBySide : m_securityIndex[secId].orders) {
+        std::transform(ordersBySide.lower_bound({minQty, 0}), ordersBySide.end(), std::back_inserter(orders),
+                       [this](const auto& entry) { return toOrder(entry.second); });
+    }
     return orders;
-}
\ No newline at end of file
+}
+
+template <typename Locking, typename Maps, typename Stats>
+size_t BasicOrderCache<Locking, Maps, Stats>::countOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                                                unsigned int minQty) const {
+    OpTimer timer(m_stats, CacheOp::COUNT_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY);
+    SharedLock lck(mtx, m_stats);
+
+    SymbolId secId;
+    if (!m_securities.find(securityId, secId)) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const auto& ordersBySide : m_securityIndex[secId].orders) {
+        count += static_cast<size_t>(std::distance(ordersBySide.lower_bound({minQty, 0}), ordersBySide.end()));
+    }
+    return count;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+CacheStatsReport BasicOrderCache<Locking, Maps, Stats>::stats() const {
+    CacheStatsReport report;
+    if constexpr (Stats::ENABLED) {
+        m_stats.collect(report);
+    }
+
+    // not timed itself, so dumping the stats doesn't show up in them
+    std::shared_lock<Mutex> lck(mtx);
+
+    report.orderCount = m_orderMap.size();
+    report.securityCount = m_securities.size();
+    report.userCount = m_users.size();
+    report.companyCount = m_companies.size();
+    report.orderPoolCapacity = m_orderPool.capacity();
+    for (SymbolId secId = 0; secId < m_securityIndex.size(); secId++) {
+        const auto& book = m_securityIndex[secId];
+        const auto orderCount = book.orders[0].size() + book.orders[1].size();
+        if (orderCount > 0) {
+            report.ordersPerSecurity.emplace_back(m_securities.name(secId), orderCount);
+        }
+    }
+    return report;
+}
+
+template class BasicOrderCache<SharedMutexLocking, FlatHashMaps, NoCacheStats>;
+template class BasicOrderCache<SharedMutexLocking, FlatHashMaps, CacheStats>;
+template class BasicOrderCache<NoLocking, FlatHashMaps, NoCacheStats>;
+template class BasicOrderCache<SharedMutexLocking, StdHashMaps, NoCacheStats>;
@@ -1,85 +1,370 @@
-#pragma once
-
-#include <map>
-#include <memory>
-#include <mutex>
-#include <string>
-#include <unordered_map>
-#include <vector>
-
-class Order {
-   public:
-    Order(const std::string& ordId, const std::string& secId, const std::string& side, const unsigned int qty,
-          const std::string& user, const std::string& company)
-        : m_orderId(ordId), m_securityId(secId), m_side(side), m_qty(qty), m_user(user), m_company(company) {}
-
-    std::string orderId() const { return m_orderId; }
-    std::string securityId() const { return m_securityId; }
-    std::string side() const { return m_side; }
-    std::string user() const { return m_user; }
-    std::string company() const { return m_company; }
-    unsigned int qty() const { return m_qty; }
-
-   private:
-    std::string m_orderId;
-    std::string m_securityId;
-    std::string m_side;
-    unsigned int m_qty;
-    std::string m_user;
-    std::string m_company;
-};
-
-class OrderCacheInterface {
-   public:
-    // add order to the cache
-    virtual void addOrder(Order order) = 0;
-
-    // remove order with this unique order id from the cache
-    virtual void cancelOrder(const std::string& orderId) = 0;
-
-    // remove all orders in the cache for this user
-    virtual void cancelOrdersForUser(const std::string& user) = 0;
-
-    // remove all orders in the cache for this security with qty >= minQty
-    virtual void cancelOrdersForSecIdWithMinimumQty(const std::string& securityId, unsigned int minQty) = 0;
-
-    // return the total qty that can match for the security id
-    virtual unsigned int getMatchingSizeForSecurity(const std::string& securityId) = 0;
-
-    // return all orders in cache in a vector
-    virtual std::vector<Order> getAllOrders() const = 0;
-};
-
-constexpr const size_t SIDE_SIZE = 2;
-
-class OrderCache : public OrderCacheInterface {
-    using UserName = std::string;
-    using OrderId = std::string;
-    using SecId = std::string;
-
-   public:
-    enum class OrderSide { BUY = 0, SELL };
-
-    void addOrder(Order order) override;
-
-    void cancelOrder(const std::string& orderId) override;
-
-    void cancelOrdersForUser(const std::string& user) override;
-
-    void cancelOrdersForSecIdWithMinimumQty(const std::string& securityId, unsigned int minQty) override;
-
-    unsigned int getMatchingSizeForSecurity(const std::string& securityId) override;
-
-    std::vector<Order> getAllOrders() const override;
-
-   private:
-    size_t toOrderSide(const std::string& sideStr);
-
-    // Indexes
-    std::unordered_map<UserName, std::unordered_map<OrderId, std::weak_ptr<Order>>> m_userIndex;
-    std::unordered_map<SecId, std::array<std::unordered_map<OrderId, std::weak_ptr<Order>>, SIDE_SIZE>> m_securityIndex;
-    // Order Storage
-    std::unordered_map<OrderId, std::shared_ptr<Order>> m_orderMap;
-    // Mutex
-    mutable std::mutex mtx;
-};
\ No newline at end of file
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "OrderCachePolicies.h"
+#include "OrderCacheStats.h"
+#include "NettingEngine.h"
+#include "OpenQtyIndex.h"
+#include "OrderCacheSubscription.h"
+#include "OrderJournal.h"
+#include "OrderPool.h"
+#include "OrderView.h"
+#include "SymbolTable.h"
+
+class Order {
+   public:
+    Order(const std::string& ordId, const std::string& secId, const std::string& side, const unsigned int qty,
+          const std::string& user, const std::string& company)
+        : m_orderId(ordId), m_securityId(secId), m_side(side), m_qty(qty), m_user(user), m_company(company) {}
+
+    const std::string& orderId() const { return m_orderId; }
+    const std::string& securityId() const { return m_securityId; }
+    const std::string& side() const { return m_side; }
+    const std::string& user() const { return m_user; }
+    const std::string& company() const { return m_company; }
+    unsigned int qty() const { return m_qty; }
+
+   private:
+    std::string m_orderId;
+    std::string m_securityId;
+    std::string m_side;
+    unsigned int m_qty;
+    std::string m_user;
+    std::string m_company;
+};
+
+class OrderCacheInterface {
+   public:
+    virtual ~OrderCacheInterface() = default;
+
+    // add order to the cache
+    virtual void addOrder(Order order) = 0;
+
+    // remove order with this unique order id from the cache
+    virtual void cancelOrder(std::string_view orderId) = 0;
+
+    // remove all orders in the cache for this user
+    virtual void cancelOrdersForUser(std::string_view user) = 0;
+
+    // remove all orders in the cache for this security with qty >= minQty
+    virtual void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) = 0;
+
+    // return the total qty that can match for the security id
+    virtual unsigned int getMatchingSizeForSecurity(std::string_view securityId) = 0;
+
+    // return all orders in cache in a vector
+    virtual std::vector<Order> getAllOrders() const = 0;
+
+    // return the total qty of the user's resting orders on this side of the security
+    virtual uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const {
+        return openQtyOf(&Order::user, user, securityId, side);
+    }
+
+    // return the total qty of the company's resting orders on this side of the security
+    virtual uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                          OrderSide side) const {
+        return openQtyOf(&Order::company, company, securityId, side);
+    }
+
+    // return the orders of this security with qty >= minQty, without cancelling them
+    virtual std::vector<Order> getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                               unsigned int minQty) const {
+        std::vector<Order> orders = getAllOrders();
+        orders.erase(std::remove_if(orders.begin(), orders.end(),
+                                    [&](const Order& order) {
+                                        return order.securityId() != securityId || order.qty() < minQty;
+                                    }),
+                     orders.end());
+        return orders;
+    }
+
+    // return the number of orders of this security with qty >= minQty
+    virtual size_t countOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) const {
+        return getOrdersForSecIdWithMinimumQty(securityId, minQty).size();
+    }
+
+    // add a batch of orders, in order; implementations may apply it under a single lock acquisition
+    virtual void addOrders(std::vector<Order> orders) {
+        for (auto& order : orders) {
+            addOrder(std::move(order));
+        }
+    }
+
+    // remove the orders with these unique order ids from the cache
+    virtual void cancelOrders(const std::vector<std::string_view>& orderIds) {
+        for (const auto& orderId : orderIds) {
+            cancelOrder(orderId);
+        }
+    }
+
+    // set the qty of this order, keeping everything else; a qty of 0 cancels it
+    virtual void amendOrderQty(std::string_view orderId, unsigned int newQty) {
+        for (const auto& order : getAllOrders()) {
+            if (order.orderId() == orderId) {
+                cancelOrder(orderId);
+                if (newQty > 0) {
+                    addOrder(Order{order.orderId(), order.securityId(), order.side(), newQty, order.user(),
+                                   order.company()});
+                }
+                return;
+            }
+        }
+    }
+
+    // take delta off the qty of this order (a partial fill), cancelling it once nothing is left
+    virtual void reduceOrderQty(std::string_view orderId, unsigned int delta) {
+        for (const auto& order : getAllOrders()) {
+            if (order.orderId() == orderId) {
+                amendOrderQty(orderId, delta < order.qty() ? order.qty() - delta : 0);
+                return;
+            }
+        }
+    }
+
+   private:
+    uint64_t openQtyOf(const std::string& (Order::*owner)() const, std::string_view ownerName,
+                       std::string_view securityId, OrderSide side) const {
+        // side names are matched case-insensitively, like the cache does
+        const std::string_view lowerCaseSide = side == OrderSide::BUY ? "buy" : "sell";
+        const auto isSide = [&](const std::string& sideName) {
+            return std::equal(sideName.begin(), sideName.end(), lowerCaseSide.begin(), lowerCaseSide.end(),
+                              [](char c, char lower) { return std::tolower(static_cast<unsigned char>(c)) == lower; });
+        };
+        uint64_t qty = 0;
+        for (const auto& order : getAllOrders()) {
+            if ((order.*owner)() == ownerName && order.securityId() == securityId && isSide(order.side())) {
+                qty += order.qty();
+            }
+        }
+        return qty;
+    }
+};
+
+// The cache is assembled from compile-time policies (see OrderCachePolicies.h and OrderCacheStats.h):
+// - Locking provides the mutex; NoLocking compiles locking out for a cache owned by a single thread
+// - Maps provides the hash map of the order id index and of the company aggregates
+// - Stats times every public operation and takes the lock, so an uninstrumented cache pays nothing for it
+// The class is final, so calls through a concrete cache type are devirtualized.
+template <typename Locking, typename Maps, typename Stats>
+class BasicOrderCache final : public OrderCacheInterface {
+   public:
+    using OrderSide = ::OrderSide;
+
+    // throws std::exception for anything other than a case-insensitive "buy" or "sell"
+    static OrderSide toOrderSide(std::string_view sideStr);
+    static const std::string& sideName(OrderSide side);
+
+    void addOrder(Order order) override;
+    // the whole batch is validated before any order is applied, then applied under one lock
+    void addOrders(std::vector<Order> orders) override;
+
+    void cancelOrder(std::string_view orderId) override;
+    void cancelOrders(const std::vector<std::string_view>& orderIds) override;
+
+    void cancelOrdersForUser(std::string_view user) override;
+    // when cancelledOrderIds is set, the ids of the cancelled orders are appended to it
+    void cancelOrdersForUser(std::string_view user, std::vector<std::string>* cancelledOrderIds);
+
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) override;
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty,
+                                            std::vector<std::string>* cancelledOrderIds);
+
+    // Update the order, its qty index entry and the security aggregates in place, without cancel and re-add. When
+    // restingQty is set it receives the qty left resting, 0 once the order is gone or if it was unknown.
+    void amendOrderQty(std::string_view orderId, unsigned int newQty) override;
+    void amendOrderQty(std::string_view orderId, unsigned int newQty, unsigned int* restingQty);
+    void reduceOrderQty(std::string_view orderId, unsigned int delta) override;
+    void reduceOrderQty(std::string_view orderId, unsigned int delta, unsigned int* restingQty);
+
+    unsigned int getMatchingSizeForSecurity(std::string_view securityId) override;
+    // Matching sizes of every security with resting orders, from one consistent view of the book and in security
+    // interning order. The securities are split across threadCount threads (0 means one per core).
+    std::vector<SecurityMatchingSize> getMatchingSizesForAllSecurities(size_t threadCount = 0) const;
+
+    // Served in O(1) from counters every add, amend and cancel path keeps up to date, without taking the lock, so
+    // risk checks never wait for a writer. A query running alongside a mass cancel may see it part-way through.
+    uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const override;
+    uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                  OrderSide side) const override;
+
+    std::vector<Order> getAllOrders() const override;
+
+    // served by the qty-ordered security index in O(log n + k)
+    std::vector<Order> getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                       unsigned int minQty) const override;
+    size_t countOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) const override;
+
+    // Calls visitor for every resting order matching filter, without copying them. Runs under the shared lock: other
+    // readers proceed, writers wait until it returns. The views are only valid inside the visitor.
+    void forEachOrder(const OrderVisitor& visitor, const OrderFilter& filter = {}) const;
+
+    // Copies the orders matching filter into a compact point-in-time snapshot. The shared lock is only held for the
+    // copy, which costs no allocation per order.
+    OrderSnapshot snapshot(const OrderFilter& filter = {}) const;
+
+    // Starts appending every write to a journal in directory, an existing directory. Entries are made durable in
+    // groups of groupCommitSize, or by syncJournal(). Enabling it takes a checkpoint of the current state, so restore()
+    // first to carry on from what the directory already holds.
+    void enableJournal(const std::string& directory,
+                       size_t groupCommitSize = OrderJournal::DEFAULT_GROUP_COMMIT_SIZE);
+    void syncJournal();
+
+    // Writes a snapshot of the resting orders, starts a new journal segment and drops the segments the snapshot
+    // covers. Writers only wait for the in-memory copy, not for the file to be written.
+    void checkpoint();
+
+    // Replaces the content of the cache with the latest snapshot in directory plus the journal entries after it, so
+    // the cost is bounded by the snapshot size and the journal tail. Journaling stays off until enableJournal().
+    void restore(const std::string& directory);
+
+    // Starts delivering the changes made to the cache from now on to a new subscription, see OrderCacheSubscription.
+    // Subscribe before querying the state to start from, so no change falls in between. Writers only pay for
+    // publishing while there is a subscriber; a subscription ends with unsubscribe() or once its holder drops it.
+    std::shared_ptr<OrderCacheSubscription> subscribe(size_t capacity = OrderCacheSubscription::DEFAULT_CAPACITY);
+    void unsubscribe(const std::shared_ptr<OrderCacheSubscription>& subscription);
+
+    // Latency histograms per operation and lock mode, merged from every thread that used the cache (empty without
+    // instrumentation), and the current index sizes. Gauges are read under the shared lock.
+    CacheStatsReport stats() const;
+
+   private:
+    using Mutex = typename Locking::Mutex;
+    template <typename Key, typename Value>
+    using HashMap = typename Maps::template Map<Key, Value>;
+    using OpTimer = typename Stats::OpTimer;
+    using ExclusiveLock = typename Stats::template ExclusiveLock<Mutex>;
+    using SharedLock = typename Stats::template SharedLock<Mutex>;
+
+    // Internal order representation: strings are interned into the symbol tables below, so a resting order is a
+    // small fixed-size record instead of six heap-allocated strings. The order id is kept by the pool.
+    struct OrderRecord {
+        SymbolId securityId;
+        SymbolId user;
+        SymbolId company;
+        unsigned int qty;
+        OrderSide side;
+        // position of the order in its user's handle list, for O(1) removal
+        uint32_t userSlot;
+    };
+
+    // orders of one security side ordered by qty, so qty thresholds only touch the orders above them
+    using QtyIndex = std::set<std::pair<unsigned int, OrderHandle>>;
+
+    struct SecurityBook {
+        std::array<QtyIndex, SIDE_SIZE> orders;
+        // open qty per company, kept up to date by every add, amend and cancel path
+        NettingEngine<HashMap<SymbolId, uint32_t>> netting;
+        // the counters of m_userOpenQty and m_companyOpenQty for this security, by owner
+        HashMap<SymbolId, OpenQtyIndex::Counters*> userOpenQty;
+        HashMap<SymbolId, OpenQtyIndex::Counters*> companyOpenQty;
+        // matching size last published to the subscribers, and whether the current write touched the book
+        unsigned int publishedMatchingSize = 0;
+        bool changed = false;
+    };
+
+    static unsigned int matchingSize(const SecurityBook& book);
+    void addToAggregates(SecurityBook& book, const OrderRecord& record);
+    void removeFromAggregates(SecurityBook& book, const OrderRecord& record);
+    void changeAggregateQty(SecurityBook& book, const OrderRecord& record, unsigned int newQty);
+    OpenQtyIndex::Counters& openQtyCounters(HashMap<SymbolId, OpenQtyIndex::Counters*>& byOwner, OpenQtyIndex& index,
+                                            const SymbolTable& owners, SymbolId owner, SymbolId securityId);
+
+    // swap-removes the entry at slot and fixes up the position of the order moved into it
+    void removeFromList(std::vector<OrderHandle>& handles, uint32_t slot, uint32_t OrderRecord::*slotField);
+    void eraseOrder(OrderHandle handle);
+    Order toOrder(OrderHandle handle) const;
+    OrderView toOrderView(OrderHandle handle) const;
+    static OrderView toOrderView(const Order& order, OrderSide side);
+
+    // calls f with the handle of every order matching filter; the caller holds the lock
+    template <typename F>
+    void visitLocked(const OrderFilter& filter, F&& f) const;
+
+    // The *Locked writers journal themselves before changing anything, so a failed journal write leaves the cache
+    // untouched
+    void addOrderLocked(const OrderView& order);
+    void insertOrderLocked(std::string_view orderId, SymbolId securityId, SymbolId userId, SymbolId companyId,
+                           unsigned int qty, OrderSide side);
+    void cancelOrderLocked(std::string_view orderId);
+    // returns the qty left resting
+    unsigned int setOrderQtyLocked(OrderHandle handle, unsigned int newQty);
+    void cancelOrdersForUserLocked(std::string_view user, std::vector<std::string>* cancelledOrderIds);
+    void cancelOrdersForSecIdWithMinimumQtyLocked(std::string_view securityId, unsigned int minQty,
+                                                  std::vector<std::string>* cancelledOrderIds);
+
+    // While there is a subscriber, the *Locked writers collect their changes and every public writer publishes them
+    // once done, still under the lock so subscribers see the writes in the order they were applied
+    bool publishingLocked() const { return !m_subscriptions.empty(); }
+    void collectLocked(OrderCacheEvent::Type type, OrderHandle handle);
+    // replaces the cancel events collected from firstEvent on with batch, holding their order ids
+    void collectBatchLocked(size_t firstEvent, OrderCacheEvent batch);
+    void publishLocked();
+    // takes the current matching sizes as the published ones, dropping whatever was collected
+    void resetPublishedLocked();
+
+    void journalLocked(const JournalEntry& entry) {
+        if (m_journal) {
+            m_journal->append(entry);
+        }
+    }
+    void applyJournalEntryLocked(const JournalEntry& entry);
+    void clearLocked();
+    // snapshot file format, see OrderCachePersistence.cpp
+    std::string serializeLocked(uint64_t sequence) const;
+    uint64_t loadSnapshotLocked(const MappedFile& file);
+
+    // Symbol tables
+    SymbolTable m_users;
+    SymbolTable m_companies;
+    SymbolTable m_securities;
+    // Indexes, addressed by symbol id
+    std::vector<std::vector<OrderHandle>> m_userIndex;
+    std::vector<SecurityBook> m_securityIndex;
+    // Order Storage: keys view the order ids held by the pool
+    HashMap<std::string_view, OrderHandle> m_orderMap;
+    OrderPool<OrderRecord> m_orderPool;
+    // Open qty by user and by company, read without the lock
+    OpenQtyIndex m_userOpenQty;
+    OpenQtyIndex m_companyOpenQty;
+    // Persistence: the journal is only replaced with writers excluded, and checkpoints are serialized
+    std::unique_ptr<OrderJournal> m_journal;
+    std::string m_journalDirectory;
+    size_t m_groupCommitSize = OrderJournal::DEFAULT_GROUP_COMMIT_SIZE;
+    // sequence of the next journal entry while journaling is off, as left by restore()
+    uint64_t m_journalSequence = 0;
+    std::mutex m_checkpointMtx;
+    // Subscriptions, and the changes of the current write collected for them
+    std::vector<std::shared_ptr<OrderCacheSubscription>> m_subscriptions;
+    std::vector<OrderCacheEvent> m_pendingEvents;
+    std::vector<SymbolId> m_changedSecurities;
+    // Mutex: queries take it shared, so readers don't block each other
+    mutable Mutex mtx;
+    mutable Stats m_stats;
+};
+
+using OrderCache = BasicOrderCache<SharedMutexLocking, FlatHashMaps, NoCacheStats>;
+using InstrumentedOrderCache = BasicOrderCache<SharedMutexLocking, FlatHashMaps, CacheStats>;
+// for a cache owned by one thread, such as a matching engine instance
+using SingleThreadedOrderCache = BasicOrderCache<NoLocking, FlatHashMaps, NoCacheStats>;
+// node-based maps, kept to compare against
+using StdHashMapOrderCache = BasicOrderCache<SharedMutexLocking, StdHashMaps, NoCacheStats>;
+
+// instantiated in OrderCache.cpp
+extern template class BasicOrderCache<SharedMutexLocking, FlatHashMaps, NoCacheStats>;
+extern template class BasicOrderCache<SharedMutexLocking, FlatHashMaps, CacheStats>;
+extern template class BasicOrderCache<NoLocking, FlatHashMaps, NoCacheStats>;
+extern template class BasicOrderCache<SharedMutexLocking, StdHashMaps, NoCacheStats>;
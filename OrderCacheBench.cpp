@@ -0,0 +1,466 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "OrderCache.h"
+#include "OrderGenerator.h"
+#include "PipelinedOrderCache.h"
+#include "ShardedOrderCache.h"
+
+// Every allocation made by a thread is counted, so benchmarks can report allocations per operation. The whole set of
+// global allocation functions is replaced, array and aligned forms included, so no allocation goes uncounted.
+namespace {
+thread_local uint64_t t_allocations = 0;
+constexpr std::size_t DEFAULT_ALIGNMENT = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void* countedAllocate(std::size_t size, std::size_t alignment, bool nothrow) {
+    t_allocations++;
+    size = size ? size : 1;
+    // aligned_alloc wants a multiple of the alignment
+    void* ptr = alignment > DEFAULT_ALIGNMENT
+                    ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                    : std::malloc(size);
+    if (!ptr && !nothrow) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// out of line, or GCC sees free() called on what operator new returned and warns of a mismatch
+[[gnu::noinline]] void countedDeallocate(void* ptr) noexcept { std::free(ptr); }
+}  // namespace
+
+void* operator new(std::size_t size) { return countedAllocate(size, DEFAULT_ALIGNMENT, false); }
+void* operator new[](std::size_t size) { return countedAllocate(size, DEFAULT_ALIGNMENT, false); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, DEFAULT_ALIGNMENT, true);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, DEFAULT_ALIGNMENT, true);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<std::size_t>(alignment), false);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, static_cast<std::size_t>(alignment), false);
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment), true);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<std::size_t>(alignment), true);
+}
+
+void operator delete(void* ptr) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr) noexcept { countedDeallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { countedDeallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { countedDeallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { countedDeallocate(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { countedDeallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { countedDeallocate(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { countedDeallocate(ptr); }
+
+namespace {
+
+// Times one operation out of SAMPLE_EVERY, which keeps the clock overhead out of the throughput numbers, and counts
+// the allocations of every operation.
+class OpRecorder {
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t SAMPLE_EVERY = 8;
+
+   public:
+    explicit OpRecorder(benchmark::State& state) : m_state(state) { m_samples.reserve(1 << 16); }
+
+    template <typename Op>
+    void run(Op&& op) {
+        const auto allocationsBefore = t_allocations;
+        if (m_ops++ % SAMPLE_EVERY == 0) {
+            const auto start = Clock::now();
+            op();
+            m_samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+        } else {
+            op();
+        }
+        m_allocations += t_allocations - allocationsBefore;
+    }
+
+    ~OpRecorder() {
+        m_state.SetItemsProcessed(static_cast<int64_t>(m_ops));
+        m_state.counters["allocs/op"] =
+            benchmark::Counter(m_ops ? static_cast<double>(m_allocations) / m_ops : 0, benchmark::Counter::kAvgThreads);
+        m_state.counters["p50_ns"] = benchmark::Counter(percentile(0.5), benchmark::Counter::kAvgThreads);
+        m_state.counters["p99_ns"] = benchmark::Counter(percentile(0.99), benchmark::Counter::kAvgThreads);
+        m_state.counters["p999_ns"] = benchmark::Counter(percentile(0.999), benchmark::Counter::kAvgThreads);
+    }
+
+   private:
+    double percentile(double rank) {
+        if (m_samples.empty()) {
+            return 0;
+        }
+        auto nth = m_samples.begin() + static_cast<ptrdiff_t>(rank * (m_samples.size() - 1));
+        std::nth_element(m_samples.begin(), nth, m_samples.end());
+        return *nth;
+    }
+
+    benchmark::State& m_state;
+    std::vector<double> m_samples;
+    uint64_t m_ops = 0;
+    uint64_t m_allocations = 0;
+};
+
+// Book shared by the threads of one benchmark run, built before the threads start
+template <typename Cache>
+struct Book {
+    static inline std::unique_ptr<Cache> cache;
+    static inline std::vector<Order> orders;
+};
+
+size_t bookSize(const benchmark::State& state) { return static_cast<size_t>(state.range(0)); }
+size_t securityCount(const benchmark::State& state) { return static_cast<size_t>(state.range(1)); }
+size_t companiesPerSecurity(const benchmark::State& state) { return static_cast<size_t>(state.range(2)); }
+
+template <typename Cache>
+void setUpBook(const benchmark::State& state) {
+    OrderGenerator generator(securityCount(state), companiesPerSecurity(state));
+    Book<Cache>::orders = generator.generate(bookSize(state));
+    Book<Cache>::cache = std::make_unique<Cache>();
+    Book<Cache>::cache->addOrders(Book<Cache>::orders);
+}
+
+template <typename Cache>
+void tearDownBook(const benchmark::State&) {
+    Book<Cache>::cache.reset();
+    Book<Cache>::orders.clear();
+}
+
+// orders of the book owned by this thread, so threads never cancel each other's orders
+std::vector<Order> threadSlice(const std::vector<Order>& orders, const benchmark::State& state) {
+    std::vector<Order> slice;
+    for (size_t i = static_cast<size_t>(state.thread_index()); i < orders.size();
+         i += static_cast<size_t>(state.threads())) {
+        slice.push_back(orders[i]);
+    }
+    return slice;
+}
+
+std::vector<std::string_view> orderIds(const std::vector<Order>& orders) {
+    std::vector<std::string_view> ids;
+    ids.reserve(orders.size());
+    for (const auto& order : orders) {
+        ids.emplace_back(order.orderId());
+    }
+    return ids;
+}
+
+template <typename Cache>
+void BM_AddOrder(benchmark::State& state) {
+    constexpr size_t INCOMING_SIZE = 1 << 14;
+
+    auto& cache = *Book<Cache>::cache;
+    OrderGenerator generator(securityCount(state), companiesPerSecurity(state), 1000 + state.thread_index(),
+                             "T" + std::to_string(state.thread_index()) + "_");
+    const auto incoming = generator.generate(INCOMING_SIZE);
+    const auto incomingIds = orderIds(incoming);
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    for (auto _ : state) {
+        if (i == incoming.size()) {
+            state.PauseTiming();
+            cache.cancelOrders(incomingIds);
+            state.ResumeTiming();
+            i = 0;
+        }
+        recorder.run([&]() { cache.addOrder(incoming[i]); });
+        i++;
+    }
+}
+
+template <typename Cache>
+void BM_CancelOrder(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+    const auto slice = threadSlice(Book<Cache>::orders, state);
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    for (auto _ : state) {
+        if (i == slice.size()) {
+            state.PauseTiming();
+            cache.addOrders(slice);
+            state.ResumeTiming();
+            i = 0;
+        }
+        recorder.run([&]() { cache.cancelOrder(slice[i].orderId()); });
+        i++;
+    }
+}
+
+template <typename Cache>
+void BM_AmendOrderQty(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+    const auto slice = threadSlice(Book<Cache>::orders, state);
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    unsigned int qtyOffset = 0;
+    for (auto _ : state) {
+        if (i == slice.size()) {
+            i = 0;
+            qtyOffset = qtyOffset ? 0 : 1;
+        }
+        recorder.run([&]() { cache.amendOrderQty(slice[i].orderId(), slice[i].qty() + qtyOffset); });
+        i++;
+    }
+}
+
+template <typename Cache>
+void BM_CancelOrdersForUser(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+    const auto& orders = Book<Cache>::orders;
+
+    std::vector<std::string> users;
+    std::unordered_map<std::string, std::vector<Order>> ordersByUser;
+    for (const auto& order : orders) {
+        auto& userOrders = ordersByUser[order.user()];
+        if (userOrders.empty()) {
+            users.push_back(order.user());
+        }
+        userOrders.push_back(order);
+    }
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& user = users[i++ % users.size()];
+        recorder.run([&]() { cache.cancelOrdersForUser(user); });
+        state.PauseTiming();
+        cache.addOrders(ordersByUser[user]);
+        state.ResumeTiming();
+    }
+}
+
+template <typename Cache>
+void BM_CancelOrdersForSecIdWithMinimumQty(benchmark::State& state) {
+    // the generator draws qty uniformly from 100..10000, so this cancels about half of a security's orders
+    constexpr unsigned int MIN_QTY = 5000;
+
+    auto& cache = *Book<Cache>::cache;
+    const auto& orders = Book<Cache>::orders;
+
+    std::vector<std::vector<Order>> cancelledBySecurity(securityCount(state));
+    for (const auto& order : orders) {
+        if (order.qty() >= MIN_QTY) {
+            cancelledBySecurity[std::stoul(order.securityId().substr(5))].push_back(order);
+        }
+    }
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto security = i++ % securityCount(state);
+        const auto securityId = OrderGenerator::securityName(security);
+        recorder.run([&]() { cache.cancelOrdersForSecIdWithMinimumQty(securityId, MIN_QTY); });
+        state.PauseTiming();
+        cache.addOrders(cancelledBySecurity[security]);
+        state.ResumeTiming();
+    }
+}
+
+template <typename Cache>
+void BM_GetMatchingSizeForSecurity(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+    std::vector<std::string> securityIds;
+    for (size_t i = 0; i < securityCount(state); i++) {
+        securityIds.push_back(OrderGenerator::securityName(i));
+    }
+
+    OpRecorder recorder(state);
+    size_t i = static_cast<size_t>(state.thread_index());
+    for (auto _ : state) {
+        const auto& securityId = securityIds[i++ % securityIds.size()];
+        recorder.run([&]() { benchmark::DoNotOptimize(cache.getMatchingSizeForSecurity(securityId)); });
+    }
+}
+
+template <typename Cache>
+void BM_GetMatchingSizesForAllSecurities(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+    const auto threadCount = static_cast<size_t>(state.range(3));
+
+    OpRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.run([&]() { benchmark::DoNotOptimize(cache.getMatchingSizesForAllSecurities(threadCount)); });
+    }
+}
+
+template <typename Cache>
+void BM_GetAllOrders(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+
+    OpRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.run([&]() { benchmark::DoNotOptimize(cache.getAllOrders()); });
+    }
+}
+
+template <typename Cache>
+void BM_ForEachOrder(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+
+    OpRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.run([&]() {
+            uint64_t totalQty = 0;
+            cache.forEachOrder([&](const OrderView& order) { totalQty += order.qty; });
+            benchmark::DoNotOptimize(totalQty);
+        });
+    }
+}
+
+template <typename Cache>
+void BM_Snapshot(benchmark::State& state) {
+    auto& cache = *Book<Cache>::cache;
+
+    OpRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.run([&]() { benchmark::DoNotOptimize(cache.snapshot()); });
+    }
+}
+
+// Order id index alone, keyed like the cache's: string views of ids stored elsewhere, looked up in random order
+std::vector<std::string> indexOrderIds(const benchmark::State& state) {
+    OrderGenerator generator(16, 4);
+    std::vector<std::string> ids;
+    for (const auto& order : generator.generate(static_cast<size_t>(state.range(0)))) {
+        ids.push_back(order.orderId());
+    }
+    return ids;
+}
+
+template <typename Map>
+void BM_OrderIdIndexFind(benchmark::State& state) {
+    const auto ids = indexOrderIds(state);
+    Map index;
+    for (size_t i = 0; i < ids.size(); i++) {
+        index.emplace(ids[i], i);
+    }
+    std::vector<std::string_view> lookups(ids.begin(), ids.end());
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937_64(42));
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.find(lookups[i]));
+        i = i + 1 == lookups.size() ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// erases an id and inserts it back, as a cancel and re-add of the same order would
+template <typename Map>
+void BM_OrderIdIndexEraseInsert(benchmark::State& state) {
+    const auto ids = indexOrderIds(state);
+    Map index;
+    for (size_t i = 0; i < ids.size(); i++) {
+        index.emplace(ids[i], i);
+    }
+
+    OpRecorder recorder(state);
+    size_t i = 0;
+    for (auto _ : state) {
+        recorder.run([&]() {
+            index.erase(std::string_view(ids[i]));
+            index.emplace(ids[i], i);
+        });
+        i = i + 1 == ids.size() ? 0 : i + 1;
+    }
+}
+
+void indexArgs(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgName("ids");
+    benchmark->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+}
+
+void bookArgs(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"book", "securities", "companies"});
+    benchmark->ArgsProduct({{1 << 14, 1 << 18}, {16, 1024}, {4, 32}});
+    benchmark->UseRealTime();
+}
+
+// many securities, with the worker thread count as last argument
+void allSecuritiesArgs(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"book", "securities", "companies", "workers"});
+    benchmark->ArgsProduct({{1 << 18}, {1 << 15}, {4, 32}, {1, 2, 4, 8}});
+    benchmark->UseRealTime();
+}
+
+}  // namespace
+
+#define ORDER_CACHE_BENCHMARK(func, cache) \
+    BENCHMARK_TEMPLATE(func, cache)->Setup(setUpBook<cache>)->Teardown(tearDownBook<cache>)->Apply(bookArgs)
+
+ORDER_CACHE_BENCHMARK(BM_AddOrder, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_AddOrder, ShardedOrderCache)->ThreadRange(1, 8);
+// the instrumented variants give the cost of the stats over the plain cache
+ORDER_CACHE_BENCHMARK(BM_AddOrder, InstrumentedOrderCache)->ThreadRange(1, 8);
+// the single-threaded cache has no locks, so it is only run from one thread
+ORDER_CACHE_BENCHMARK(BM_AddOrder, SingleThreadedOrderCache);
+// the node-based maps the flat ones replaced
+ORDER_CACHE_BENCHMARK(BM_AddOrder, StdHashMapOrderCache);
+// the pipelined cache only times the enqueue, but a full queue pushes back on producers at the apply rate
+ORDER_CACHE_BENCHMARK(BM_AddOrder, PipelinedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_CancelOrder, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_CancelOrder, ShardedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_CancelOrder, PipelinedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_CancelOrder, SingleThreadedOrderCache);
+ORDER_CACHE_BENCHMARK(BM_CancelOrder, StdHashMapOrderCache);
+ORDER_CACHE_BENCHMARK(BM_AmendOrderQty, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_AmendOrderQty, ShardedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_AmendOrderQty, PipelinedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_AmendOrderQty, SingleThreadedOrderCache);
+ORDER_CACHE_BENCHMARK(BM_CancelOrdersForUser, OrderCache);
+ORDER_CACHE_BENCHMARK(BM_CancelOrdersForUser, ShardedOrderCache);
+ORDER_CACHE_BENCHMARK(BM_CancelOrdersForSecIdWithMinimumQty, OrderCache);
+ORDER_CACHE_BENCHMARK(BM_CancelOrdersForSecIdWithMinimumQty, ShardedOrderCache);
+ORDER_CACHE_BENCHMARK(BM_GetMatchingSizeForSecurity, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_GetMatchingSizeForSecurity, ShardedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_GetMatchingSizeForSecurity, InstrumentedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_GetMatchingSizeForSecurity, SingleThreadedOrderCache);
+ORDER_CACHE_BENCHMARK(BM_GetMatchingSizeForSecurity, StdHashMapOrderCache);
+BENCHMARK_TEMPLATE(BM_GetMatchingSizesForAllSecurities, OrderCache)
+    ->Setup(setUpBook<OrderCache>)
+    ->Teardown(tearDownBook<OrderCache>)
+    ->Apply(allSecuritiesArgs);
+BENCHMARK_TEMPLATE(BM_GetMatchingSizesForAllSecurities, ShardedOrderCache)
+    ->Setup(setUpBook<ShardedOrderCache>)
+    ->Teardown(tearDownBook<ShardedOrderCache>)
+    ->Apply(allSecuritiesArgs);
+ORDER_CACHE_BENCHMARK(BM_GetAllOrders, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_GetAllOrders, ShardedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_ForEachOrder, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_ForEachOrder, ShardedOrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_Snapshot, OrderCache)->ThreadRange(1, 8);
+ORDER_CACHE_BENCHMARK(BM_Snapshot, ShardedOrderCache)->ThreadRange(1, 8);
+
+using StdOrderIdIndex = std::unordered_map<std::string_view, size_t>;
+using FlatOrderIdIndex = FlatHashMap<std::string_view, size_t>;
+BENCHMARK_TEMPLATE(BM_OrderIdIndexFind, StdOrderIdIndex)->Apply(indexArgs);
+BENCHMARK_TEMPLATE(BM_OrderIdIndexFind, FlatOrderIdIndex)->Apply(indexArgs);
+BENCHMARK_TEMPLATE(BM_OrderIdIndexEraseInsert, StdOrderIdIndex)->Apply(indexArgs);
+BENCHMARK_TEMPLATE(BM_OrderIdIndexEraseInsert, FlatOrderIdIndex)->Apply(indexArgs);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,297 @@
+#include "OrderCache.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+constexpr const char* SNAPSHOT_FILE = "snapshot.bin";
+constexpr char SNAPSHOT_MAGIC[8] = "OCSNAP1";
+
+// Snapshot layout: the header, then one fixed-size record per resting order, then the order ids back to back, then
+// the security, user and company symbol tables in id order as length-prefixed strings. Everything is 8-byte aligned
+// and in native byte order, so the records can be read in place from a mapping of the file.
+struct SnapshotHeader {
+    char magic[8];
+    // first journal entry not covered by the snapshot
+    uint64_t sequence;
+    uint32_t securityCount;
+    uint32_t userCount;
+    uint32_t companyCount;
+    uint32_t orderCount;
+    uint64_t orderIdsOffset;
+    uint64_t symbolsOffset;
+    uint64_t size;
+    // of everything after the header
+    uint32_t checksum;
+    uint32_t padding;
+};
+
+struct SnapshotRecord {
+    uint64_t orderIdOffset;
+    uint32_t orderIdLength;
+    SymbolId securityId;
+    SymbolId user;
+    SymbolId company;
+    uint32_t qty;
+    uint8_t side;
+    uint8_t padding[3];
+};
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotRecord) % 8 == 0,
+              "snapshot sections must stay aligned");
+
+void appendSymbols(std::string& buffer, const SymbolTable& symbols) {
+    for (SymbolId id = 0; id < symbols.size(); id++) {
+        const auto& name = symbols.name(id);
+        const auto length = static_cast<uint32_t>(name.size());
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        buffer.append(name);
+    }
+}
+
+[[noreturn]] void throwCorrupt(const char* what) { throw std::runtime_error(std::string("corrupt snapshot: ") + what); }
+
+}  // namespace
+
+template <typename Locking, typename Maps, typename Stats>
+std::string BasicOrderCache<Locking, Maps, Stats>::serializeLocked(uint64_t sequence) const {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.sequence = sequence;
+    header.securityCount = static_cast<uint32_t>(m_securities.size());
+    header.userCount = static_cast<uint32_t>(m_users.size());
+    header.companyCount = static_cast<uint32_t>(m_companies.size());
+    header.orderCount = static_cast<uint32_t>(m_orderMap.size());
+
+    std::string buffer(sizeof(SnapshotHeader) + m_orderMap.size() * sizeof(SnapshotRecord), '\0');
+    header.orderIdsOffset = buffer.size();
+    buffer.reserve(buffer.size() + m_orderMap.size() * 16);
+
+    auto* records = reinterpret_cast<SnapshotRecord*>(&buffer[sizeof(SnapshotHeader)]);
+    size_t i = 0;
+    for (const auto& [orderId, handle] : m_orderMap) {
+        const auto& record = m_orderPool[handle];
+        SnapshotRecord snapshotRecord{};
+        snapshotRecord.orderIdOffset = buffer.size() - header.orderIdsOffset;
+        snapshotRecord.orderIdLength = static_cast<uint32_t>(orderId.size());
+        snapshotRecord.securityId = record.securityId;
+        snapshotRecord.user = record.user;
+        snapshotRecord.company = record.company;
+        snapshotRecord.qty = record.qty;
+        snapshotRecord.side = static_cast<uint8_t>(record.side);
+        // appending may reallocate the buffer, so records are written through a fresh pointer
+        buffer.append(orderId);
+        records = reinterpret_cast<SnapshotRecord*>(&buffer[sizeof(SnapshotHeader)]);
+        std::memcpy(&records[i++], &snapshotRecord, sizeof(snapshotRecord));
+    }
+
+    buffer.append((8 - buffer.size() % 8) % 8, '\0');
+    header.symbolsOffset = buffer.size();
+    appendSymbols(buffer, m_securities);
+    appendSymbols(buffer, m_users);
+    appendSymbols(buffer, m_companies);
+
+    header.size = buffer.size();
+    header.checksum = journalChecksum(std::string_view(buffer).substr(sizeof(SnapshotHeader)));
+    std::memcpy(&buffer[0], &header, sizeof(header));
+    return buffer;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+uint64_t BasicOrderCache<Locking, Maps, Stats>::loadSnapshotLocked(const MappedFile& file) {
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)) {
+        throwCorrupt("truncated header");
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.size != file.size() ||
+        header.orderIdsOffset != sizeof(header) + uint64_t{header.orderCount} * sizeof(SnapshotRecord) ||
+        header.symbolsOffset < header.orderIdsOffset || header.symbolsOffset > header.size) {
+        throwCorrupt("bad header");
+    }
+    const std::string_view content(file.data(), file.size());
+    if (journalChecksum(content.substr(sizeof(header))) != header.checksum) {
+        throwCorrupt("checksum mismatch");
+    }
+
+    // interning in id order gives every symbol back its snapshot id
+    size_t offset = header.symbolsOffset;
+    auto loadSymbols = [&](SymbolTable& symbols, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t length;
+            if (header.size - offset < sizeof(length)) {
+                throwCorrupt("truncated symbol table");
+            }
+            std::memcpy(&length, file.data() + offset, sizeof(length));
+            offset += sizeof(length);
+            if (header.size - offset < length) {
+                throwCorrupt("truncated symbol table");
+            }
+            symbols.intern(std::string_view(file.data() + offset, length));
+            offset += length;
+        }
+    };
+    loadSymbols(m_securities, header.securityCount);
+    loadSymbols(m_users, header.userCount);
+    loadSymbols(m_companies, header.companyCount);
+    if (m_securities.size() != header.securityCount || m_users.size() != header.userCount ||
+        m_companies.size() != header.companyCount) {
+        throwCorrupt("duplicate symbols");
+    }
+    // symbols without resting orders are interned too, and every interned symbol must have an index entry
+    m_securityIndex.resize(m_securities.size());
+    m_userIndex.resize(m_users.size());
+
+    m_orderMap.reserve(header.orderCount);
+    m_orderPool.reserve(header.orderCount);
+    const auto orderIds = content.substr(header.orderIdsOffset, header.symbolsOffset - header.orderIdsOffset);
+    for (uint32_t i = 0; i < header.orderCount; i++) {
+        SnapshotRecord record;
+        std::memcpy(&record, file.data() + sizeof(header) + i * sizeof(SnapshotRecord), sizeof(record));
+        if (record.orderIdOffset > orderIds.size() || orderIds.size() - record.orderIdOffset < record.orderIdLength ||
+            record.securityId >= header.securityCount || record.user >= header.userCount ||
+            record.company >= header.companyCount || record.side >= SIDE_SIZE) {
+            throwCorrupt("bad order record");
+        }
+        insertOrderLocked(orderIds.substr(record.orderIdOffset, record.orderIdLength), record.securityId, record.user,
+                          record.company, record.qty, static_cast<OrderSide>(record.side));
+    }
+    return header.sequence;
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::applyJournalEntryLocked(const JournalEntry& entry) {
+    switch (entry.type) {
+        case JournalEntry::Type::ADD:
+            addOrderLocked(
+                OrderView{entry.orderId, entry.securityId, entry.side, entry.qty, entry.user, entry.company});
+            break;
+        case JournalEntry::Type::CANCEL:
+            cancelOrderLocked(entry.orderId);
+            break;
+        case JournalEntry::Type::AMEND_QTY: {
+            const auto& orderMapIt = m_orderMap.find(entry.orderId);
+            if (orderMapIt != m_orderMap.end()) {
+                setOrderQtyLocked(orderMapIt->second, entry.qty);
+            }
+            break;
+        }
+        case JournalEntry::Type::CANCEL_USER:
+            cancelOrdersForUserLocked(entry.user, nullptr);
+            break;
+        case JournalEntry::Type::CANCEL_SEC_ID_MIN_QTY:
+            cancelOrdersForSecIdWithMinimumQtyLocked(entry.securityId, entry.qty, nullptr);
+            break;
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::clearLocked() {
+    m_users = SymbolTable();
+    m_companies = SymbolTable();
+    m_securities = SymbolTable();
+    m_userIndex.clear();
+    m_securityIndex.clear();
+    m_orderMap.clear();
+    m_orderPool = OrderPool<OrderRecord>();
+    // the counters stay, as readers may be looking at them
+    m_userOpenQty.reset();
+    m_companyOpenQty.reset();
+    m_pendingEvents.clear();
+    m_changedSecurities.clear();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::enableJournal(const std::string& directory, size_t groupCommitSize) {
+    {
+        std::lock_guard<std::mutex> checkpointLck(m_checkpointMtx);
+        ExclusiveLock lck(mtx, m_stats);
+
+        // continue after whatever the directory holds, so no stale segment can be mistaken for a newer one
+        const auto sequence =
+            std::max(m_journal ? m_journal->nextSequence() : m_journalSequence, OrderJournal::endSequence(directory));
+        m_journal.reset();
+        m_journalDirectory = directory;
+        m_groupCommitSize = groupCommitSize;
+        m_journal = std::make_unique<OrderJournal>(directory, sequence, groupCommitSize);
+    }
+    checkpoint();
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::syncJournal() {
+    ExclusiveLock lck(mtx, m_stats);
+
+    if (m_journal) {
+        m_journal->commit();
+    }
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::checkpoint() {
+    std::lock_guard<std::mutex> checkpointLck(m_checkpointMtx);
+
+    std::string snapshot;
+    uint64_t sequence;
+    {
+        // Writers are excluded for the copy, so nothing is journaled between the snapshot and the rotation. Readers
+        // never touch m_journal, which makes replacing it under the shared lock safe.
+        SharedLock lck(mtx, m_stats);
+
+        if (!m_journal) {
+            throw std::logic_error("checkpoint requires enableJournal");
+        }
+        sequence = m_journal->nextSequence();
+        snapshot = serializeLocked(sequence);
+        m_journal->commit();
+        m_journal = std::make_unique<OrderJournal>(m_journalDirectory, sequence, m_groupCommitSize);
+    }
+
+    writeFileAtomically(m_journalDirectory + "/" + SNAPSHOT_FILE, snapshot);
+    OrderJournal::removeSegmentsBefore(m_journalDirectory, sequence);
+}
+
+template <typename Locking, typename Maps, typename Stats>
+void BasicOrderCache<Locking, Maps, Stats>::restore(const std::string& directory) {
+    std::lock_guard<std::mutex> checkpointLck(m_checkpointMtx);
+    ExclusiveLock lck(mtx, m_stats);
+
+    m_journal.reset();
+    clearLocked();
+
+    uint64_t sequence = 0;
+    const auto snapshotPath = directory + "/" + SNAPSHOT_FILE;
+    if (::access(snapshotPath.c_str(), F_OK) == 0) {
+        sequence = loadSnapshotLocked(MappedFile(snapshotPath));
+    }
+    m_journalSequence = OrderJournal::replay(directory, sequence,
+                                             [this](const JournalEntry& entry) { applyJournalEntryLocked(entry); });
+
+    // subscribers start over from the restored state rather than from every order it re-added
+    if (publishingLocked()) {
+        resetPublishedLocked();
+        for (const auto& subscription : m_subscriptions) {
+            subscription->publishResync();
+        }
+    }
+}
+
+// the class itself is instantiated in OrderCache.cpp, which can't see the definitions above
+#define INSTANTIATE_PERSISTENCE(Cache)                                               \
+    template std::string Cache::serializeLocked(uint64_t) const;                     \
+    template uint64_t Cache::loadSnapshotLocked(const MappedFile&);                  \
+    template void Cache::applyJournalEntryLocked(const JournalEntry&);               \
+    template void Cache::clearLocked();                                              \
+    template void Cache::enableJournal(const std::string&, size_t);                  \
+    template void Cache::syncJournal();                                              \
+    template void Cache::checkpoint();                                               \
+    template void Cache::restore(const std::string&);
+
+INSTANTIATE_PERSISTENCE(OrderCache)
+INSTANTIATE_PERSISTENCE(InstrumentedOrderCache)
+INSTANTIATE_PERSISTENCE(SingleThreadedOrderCache)
+INSTANTIATE_PERSISTENCE(StdHashMapOrderCache)
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "FlatHashMap.h"
+
+// Locking policies: the mutex guarding a cache, taken exclusively by writers and shared by readers
+
+struct SharedMutexLocking {
+    using Mutex = std::shared_mutex;
+};
+
+// Locking policy of a cache only ever used from one thread: every lock operation is a no-op
+struct NoLocking {
+    struct Mutex {
+        void lock() {}
+        bool try_lock() { return true; }
+        void unlock() {}
+        void lock_shared() {}
+        bool try_lock_shared() { return true; }
+        void unlock_shared() {}
+    };
+};
+
+// Map policies: the hash map behind the order id index and the per-security company aggregates
+
+struct StdHashMaps {
+    template <typename Key, typename Value>
+    using Map = std::unordered_map<Key, Value>;
+};
+
+// open addressing, see FlatHashMap.h
+struct FlatHashMaps {
+    template <typename Key, typename Value>
+    using Map = FlatHashMap<Key, Value>;
+};
@@ -0,0 +1,160 @@
+#include "OrderCacheStats.h"
+
+#include <iomanip>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+std::string_view cacheOpName(CacheOp op) {
+    static constexpr std::array<std::string_view, CACHE_OP_COUNT> names = {
+        "addOrder",
+        "addOrders",
+        "cancelOrder",
+        "cancelOrders",
+        "amendOrderQty",
+        "reduceOrderQty",
+        "cancelOrdersForUser",
+        "cancelOrdersForSecIdWithMinimumQty",
+        "getMatchingSizeForSecurity",
+        "getMatchingSizesForAllSecurities",
+        "getAllOrders",
+        "getOrdersForSecIdWithMinimumQty",
+        "countOrdersForSecIdWithMinimumQty",
+        "getOpenQty",
+        "forEachOrder",
+        "snapshot",
+    };
+    return names[static_cast<size_t>(op)];
+}
+
+uint64_t LatencyHistogram::percentileNs(double q) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    const auto rank = static_cast<uint64_t>(q * static_cast<double>(m_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+        seen += m_counts[bucket];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(bucket), m_maxNs);
+        }
+    }
+    return m_maxNs;
+}
+
+void LatencyHistogram::printHeader(std::ostream& out, std::string_view firstColumn) {
+    out << std::left << std::setw(40) << firstColumn << std::right << std::setw(12) << "count" << std::setw(12)
+        << "mean_ns" << std::setw(12) << "p50_ns" << std::setw(12) << "p99_ns" << std::setw(12) << "p999_ns"
+        << std::setw(12) << "max_ns" << '\n';
+}
+
+void LatencyHistogram::print(std::ostream& out, std::string_view name) const {
+    out << std::left << std::setw(40) << name << std::right << std::setw(12) << count() << std::setw(12)
+        << static_cast<uint64_t>(meanNs()) << std::setw(12) << percentileNs(0.5) << std::setw(12)
+        << percentileNs(0.99) << std::setw(12) << percentileNs(0.999) << std::setw(12) << maxNs() << '\n';
+}
+
+void CacheStatsReport::print(std::ostream& out, size_t topSecurities) const {
+    LatencyHistogram::printHeader(out, "operation");
+    for (size_t op = 0; op < CACHE_OP_COUNT; op++) {
+        if (ops[op].count() > 0) {
+            ops[op].print(out, cacheOpName(static_cast<CacheOp>(op)));
+        }
+    }
+    for (size_t mode = 0; mode < LOCK_MODE_COUNT; mode++) {
+        const std::string_view modeName = mode == static_cast<size_t>(LockMode::SHARED) ? "shared" : "exclusive";
+        if (lockHold[mode].count() > 0) {
+            lockWait[mode].print(out, std::string("lock wait (").append(modeName) + ")");
+            lockHold[mode].print(out, std::string("lock hold (").append(modeName) + ")");
+            out << "contended " << modeName << " locks: " << contendedLocks[mode] << '\n';
+        }
+    }
+
+    out << "orders: " << orderCount << ", securities: " << securityCount << ", users: " << userCount
+        << ", companies: " << companyCount << ", order pool capacity: " << orderPoolCapacity << '\n';
+
+    auto busiest = ordersPerSecurity;
+    const auto shown = std::min(topSecurities, busiest.size());
+    std::partial_sort(busiest.begin(), busiest.begin() + static_cast<ptrdiff_t>(shown), busiest.end(),
+                      [](const auto& lhs, const auto& rhs) { return lhs.second > rhs.second; });
+    for (size_t i = 0; i < shown; i++) {
+        out << "  " << busiest[i].first << ": " << busiest[i].second << " orders\n";
+    }
+}
+
+CacheStats::CacheStats()
+    : m_instanceId([]() {
+          static std::atomic<uint64_t> nextInstanceId{1};
+          return nextInstanceId.fetch_add(1, std::memory_order_relaxed);
+      }()) {}
+
+CacheStats::ThreadCounters& CacheStats::registerThread() {
+    struct InstanceCounters {
+        std::weak_ptr<const bool> lifetime;
+        ThreadCounters* counters;
+    };
+    thread_local std::unordered_map<uint64_t, InstanceCounters> countersByInstance;
+
+    const auto countersIt = countersByInstance.find(m_instanceId);
+    if (countersIt != countersByInstance.end()) {
+        return *countersIt->second.counters;
+    }
+
+    // the counters of destroyed instances went with them
+    for (auto it = countersByInstance.begin(); it != countersByInstance.end();) {
+        it = it->second.lifetime.expired() ? countersByInstance.erase(it) : std::next(it);
+    }
+
+    std::lock_guard<std::mutex> lck(m_threadsMtx);
+    m_threads.push_back(std::make_unique<ThreadCounters>());
+    countersByInstance.emplace(m_instanceId, InstanceCounters{m_lifetime, m_threads.back().get()});
+    return *m_threads.back();
+}
+
+void CacheStats::ThreadHistogram::addTo(LatencyHistogram& histogram) const {
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; bucket++) {
+        if (const auto count = counts[bucket].load()) {
+            histogram.add(bucket, count, 0, 0);
+        }
+    }
+    histogram.add(0, 0, sumNs.load(), maxNs.load());
+}
+
+void CacheStats::collect(CacheStatsReport& report) const {
+    std::lock_guard<std::mutex> lck(m_threadsMtx);
+
+    for (const auto& counters : m_threads) {
+        for (size_t op = 0; op < CACHE_OP_COUNT; op++) {
+            counters->ops[op].addTo(report.ops[op]);
+        }
+        for (size_t mode = 0; mode < LOCK_MODE_COUNT; mode++) {
+            counters->lockWait[mode].addTo(report.lockWait[mode]);
+            counters->lockHold[mode].addTo(report.lockHold[mode]);
+            report.contendedLocks[mode] += counters->contendedLocks[mode].load();
+        }
+    }
+}
+
+StatsDumper::StatsDumper(std::function<CacheStatsReport()> collect, std::chrono::milliseconds interval,
+                         std::ostream& out)
+    : m_collect(std::move(collect)), m_interval(interval), m_out(out), m_thread(&StatsDumper::run, this) {}
+
+StatsDumper::~StatsDumper() {
+    {
+        std::lock_guard<std::mutex> lck(m_mtx);
+        m_stopping = true;
+    }
+    m_stopped.notify_one();
+    m_thread.join();
+}
+
+void StatsDumper::run() {
+    std::unique_lock<std::mutex> lck(m_mtx);
+    while (!m_stopped.wait_for(lck, m_interval, [this]() { return m_stopping; })) {
+        lck.unlock();
+        m_collect().print(m_out);
+        m_out.flush();
+        lck.lock();
+    }
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Public OrderCache operations, as reported by the stats
+enum class CacheOp : uint8_t {
+    ADD_ORDER = 0,
+    ADD_ORDERS,
+    CANCEL_ORDER,
+    CANCEL_ORDERS,
+    AMEND_ORDER_QTY,
+    REDUCE_ORDER_QTY,
+    CANCEL_ORDERS_FOR_USER,
+    CANCEL_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY,
+    GET_MATCHING_SIZE_FOR_SECURITY,
+    GET_MATCHING_SIZES_FOR_ALL_SECURITIES,
+    GET_ALL_ORDERS,
+    GET_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY,
+    COUNT_ORDERS_FOR_SEC_ID_WITH_MINIMUM_QTY,
+    GET_OPEN_QTY,
+    FOR_EACH_ORDER,
+    SNAPSHOT,
+};
+constexpr const size_t CACHE_OP_COUNT = static_cast<size_t>(CacheOp::SNAPSHOT) + 1;
+
+std::string_view cacheOpName(CacheOp op);
+
+enum class LockMode : uint8_t { SHARED = 0, EXCLUSIVE };
+constexpr const size_t LOCK_MODE_COUNT = 2;
+
+// HDR-style latency histogram: 16 linear buckets per power of two, so any recorded value is reported within 1/16 of
+// its actual value, from 1ns up to 2^40ns (about 18 minutes; anything longer lands in the top bucket).
+class LatencyHistogram {
+   public:
+    static constexpr unsigned int SUB_BUCKET_BITS = 4;
+    static constexpr unsigned int MAGNITUDES = 40;
+    static constexpr size_t BUCKET_COUNT = size_t{MAGNITUDES - SUB_BUCKET_BITS + 1} << SUB_BUCKET_BITS;
+
+    static size_t bucketFor(uint64_t ns) {
+        constexpr uint64_t subBuckets = uint64_t{1} << SUB_BUCKET_BITS;
+        ns = std::min(ns, (uint64_t{1} << MAGNITUDES) - 1);
+        if (ns < subBuckets) {
+            return static_cast<size_t>(ns);
+        }
+        const unsigned int shift = 63 - static_cast<unsigned int>(__builtin_clzll(ns)) - SUB_BUCKET_BITS;
+        return ((size_t{shift} + 1) << SUB_BUCKET_BITS) + static_cast<size_t>((ns >> shift) - subBuckets);
+    }
+
+    // largest value recorded into bucket
+    static uint64_t bucketUpperBound(size_t bucket) {
+        constexpr size_t subBuckets = size_t{1} << SUB_BUCKET_BITS;
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        const size_t shift = (bucket >> SUB_BUCKET_BITS) - 1;
+        return ((uint64_t{subBuckets + (bucket & (subBuckets - 1)) + 1}) << shift) - 1;
+    }
+
+    void record(uint64_t ns) { add(bucketFor(ns), 1, ns, ns); }
+
+    void add(size_t bucket, uint64_t count, uint64_t sumNs, uint64_t maxNs) {
+        m_counts[bucket] += count;
+        m_count += count;
+        m_sumNs += sumNs;
+        m_maxNs = std::max(m_maxNs, maxNs);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+            m_counts[bucket] += other.m_counts[bucket];
+        }
+        m_count += other.m_count;
+        m_sumNs += other.m_sumNs;
+        m_maxNs = std::max(m_maxNs, other.m_maxNs);
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t maxNs() const { return m_maxNs; }
+    double meanNs() const { return m_count ? static_cast<double>(m_sumNs) / static_cast<double>(m_count) : 0; }
+
+    // upper bound of the bucket holding the value at quantile q (0..1), 0 when empty
+    uint64_t percentileNs(double q) const;
+
+    // one row of a table of histograms, under the header printed by printHeader
+    static void printHeader(std::ostream& out, std::string_view firstColumn);
+    void print(std::ostream& out, std::string_view name) const;
+
+   private:
+    std::array<uint64_t, BUCKET_COUNT> m_counts{};
+    uint64_t m_count = 0;
+    uint64_t m_sumNs = 0;
+    uint64_t m_maxNs = 0;
+};
+
+// Point-in-time copy of a cache's stats: latency histograms when instrumentation is compiled in, gauges always
+struct CacheStatsReport {
+    std::array<LatencyHistogram, CACHE_OP_COUNT> ops;
+    std::array<LatencyHistogram, LOCK_MODE_COUNT> lockWait;
+    std::array<LatencyHistogram, LOCK_MODE_COUNT> lockHold;
+    // acquisitions that found the lock taken and had to wait
+    std::array<uint64_t, LOCK_MODE_COUNT> contendedLocks{};
+
+    size_t orderCount = 0;
+    size_t securityCount = 0;
+    size_t userCount = 0;
+    size_t companyCount = 0;
+    size_t orderPoolCapacity = 0;
+    // resting orders of every security that has some; the ids are viewed in the cache's symbol table
+    std::vector<std::pair<std::string_view, size_t>> ordersPerSecurity;
+
+    // human-readable dump, listing the topSecurities securities with the most orders
+    void print(std::ostream& out, size_t topSecurities = 10) const;
+};
+
+// Stats policy of an uninstrumented cache: every hook is empty, so it compiles down to nothing
+struct NoCacheStats {
+    static constexpr bool ENABLED = false;
+
+    struct OpTimer {
+        OpTimer(NoCacheStats&, CacheOp) {}
+    };
+
+    template <typename Mutex>
+    struct ExclusiveLock : std::lock_guard<Mutex> {
+        ExclusiveLock(Mutex& mutex, NoCacheStats&) : std::lock_guard<Mutex>(mutex) {}
+    };
+
+    template <typename Mutex>
+    struct SharedLock : std::shared_lock<Mutex> {
+        SharedLock(Mutex& mutex, NoCacheStats&) : std::shared_lock<Mutex>(mutex) {}
+    };
+};
+
+// Stats policy of an instrumented cache. Every thread records into its own counters (single-writer relaxed atomics,
+// so recording needs no read-modify-write), and collect() merges them. Per operation it costs two clock reads for
+// the op latency and two for the lock hold time, plus two more for the wait when the lock is contended.
+class CacheStats {
+   public:
+    static constexpr bool ENABLED = true;
+    using Clock = std::chrono::steady_clock;
+
+    CacheStats();
+    CacheStats(const CacheStats&) = delete;
+    CacheStats& operator=(const CacheStats&) = delete;
+
+    static uint64_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }
+
+    void recordOp(CacheOp op, uint64_t ns) { local().ops[static_cast<size_t>(op)].record(ns); }
+
+    void recordLock(LockMode mode, uint64_t waitNs, uint64_t holdNs, bool contended) {
+        auto& counters = local();
+        counters.lockWait[static_cast<size_t>(mode)].record(waitNs);
+        counters.lockHold[static_cast<size_t>(mode)].record(holdNs);
+        if (contended) {
+            counters.contendedLocks[static_cast<size_t>(mode)].increment();
+        }
+    }
+
+    // adds the counters of every thread to the histograms of report
+    void collect(CacheStatsReport& report) const;
+
+    class OpTimer {
+       public:
+        OpTimer(CacheStats& stats, CacheOp op) : m_stats(stats), m_op(op), m_start(Clock::now()) {}
+        ~OpTimer() { m_stats.recordOp(m_op, elapsedNs(m_start, Clock::now())); }
+
+       private:
+        CacheStats& m_stats;
+        CacheOp m_op;
+        Clock::time_point m_start;
+    };
+
+    template <typename Mutex>
+    class ExclusiveLock {
+       public:
+        ExclusiveLock(Mutex& mutex, CacheStats& stats) : m_mutex(mutex), m_stats(stats) {
+            m_contended = !mutex.try_lock();
+            if (m_contended) {
+                const auto start = Clock::now();
+                mutex.lock();
+                m_acquired = Clock::now();
+                m_waitNs = elapsedNs(start, m_acquired);
+            } else {
+                m_acquired = Clock::now();
+            }
+        }
+
+        ~ExclusiveLock() {
+            const auto released = Clock::now();
+            m_mutex.unlock();
+            m_stats.recordLock(LockMode::EXCLUSIVE, m_waitNs, elapsedNs(m_acquired, released), m_contended);
+        }
+
+        ExclusiveLock(const ExclusiveLock&) = delete;
+        ExclusiveLock& operator=(const ExclusiveLock&) = delete;
+
+       private:
+        Mutex& m_mutex;
+        CacheStats& m_stats;
+        Clock::time_point m_acquired;
+        uint64_t m_waitNs = 0;
+        bool m_contended;
+    };
+
+    template <typename Mutex>
+    class SharedLock {
+       public:
+        SharedLock(Mutex& mutex, CacheStats& stats) : m_mutex(mutex), m_stats(stats) {
+            m_contended = !mutex.try_lock_shared();
+            if (m_contended) {
+                const auto start = Clock::now();
+                mutex.lock_shared();
+                m_acquired = Clock::now();
+                m_waitNs = elapsedNs(start, m_acquired);
+            } else {
+                m_acquired = Clock::now();
+            }
+        }
+
+        ~SharedLock() {
+            const auto released = Clock::now();
+            m_mutex.unlock_shared();
+            m_stats.recordLock(LockMode::SHARED, m_waitNs, elapsedNs(m_acquired, released), m_contended);
+        }
+
+        SharedLock(const SharedLock&) = delete;
+        SharedLock& operator=(const SharedLock&) = delete;
+
+       private:
+        Mutex& m_mutex;
+        CacheStats& m_stats;
+        Clock::time_point m_acquired;
+        uint64_t m_waitNs = 0;
+        bool m_contended;
+    };
+
+   private:
+    // counter written by one thread and read by collect()
+    struct RelaxedCounter {
+        std::atomic<uint64_t> value{0};
+
+        void increment() { add(1); }
+        void add(uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+        uint64_t load() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    struct ThreadHistogram {
+        std::array<RelaxedCounter, LatencyHistogram::BUCKET_COUNT> counts;
+        RelaxedCounter sumNs;
+        RelaxedCounter maxNs;
+
+        void record(uint64_t ns) {
+            counts[LatencyHistogram::bucketFor(ns)].increment();
+            sumNs.add(ns);
+            if (ns > maxNs.load()) {
+                maxNs.value.store(ns, std::memory_order_relaxed);
+            }
+        }
+        void addTo(LatencyHistogram& histogram) const;
+    };
+
+    struct ThreadCounters {
+        std::array<ThreadHistogram, CACHE_OP_COUNT> ops;
+        std::array<ThreadHistogram, LOCK_MODE_COUNT> lockWait;
+        std::array<ThreadHistogram, LOCK_MODE_COUNT> lockHold;
+        std::array<RelaxedCounter, LOCK_MODE_COUNT> contendedLocks;
+    };
+
+    ThreadCounters& local() {
+        // a thread mostly works on one cache, so the last one it used is remembered
+        thread_local uint64_t lastInstanceId = 0;
+        thread_local ThreadCounters* lastCounters = nullptr;
+        if (lastInstanceId != m_instanceId) {
+            lastCounters = &registerThread();
+            lastInstanceId = m_instanceId;
+        }
+        return *lastCounters;
+    }
+    ThreadCounters& registerThread();
+
+    // never reused, unlike addresses, so a thread can't mistake a new cache for a destroyed one
+    const uint64_t m_instanceId;
+    // expires with the instance, so threads can drop what they remember of it
+    const std::shared_ptr<const bool> m_lifetime = std::make_shared<const bool>(true);
+    mutable std::mutex m_threadsMtx;
+    std::vector<std::unique_ptr<ThreadCounters>> m_threads;
+};
+
+// Prints the report returned by collect to out every interval, from its own thread, until destroyed
+class StatsDumper {
+   public:
+    StatsDumper(std::function<CacheStatsReport()> collect, std::chrono::milliseconds interval, std::ostream& out);
+    ~StatsDumper();
+
+    StatsDumper(const StatsDumper&) = delete;
+    StatsDumper& operator=(const StatsDumper&) = delete;
+
+   private:
+    void run();
+
+    std::function<CacheStatsReport()> m_collect;
+    std::chrono::milliseconds m_interval;
+    std::ostream& m_out;
+    std::mutex m_mtx;
+    std::condition_variable m_stopped;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,99 @@
+#include "OrderCacheSubscription.h"
+
+#include <utility>
+
+OrderCacheSubscription::OrderCacheSubscription(size_t capacity) : m_queue(capacity) {}
+
+bool OrderCacheSubscription::poll(OrderCacheEvent& event) {
+    Item item;
+    if (m_resync.load(std::memory_order_acquire)) {
+        // the publisher pushes nothing until the flag is cleared, so this empties the queue for good
+        while (m_queue.tryPop(item)) {
+            if (item.matchingSize) {
+                item.matchingSize->queued.store(false, std::memory_order_relaxed);
+            }
+        }
+        m_resync.store(false, std::memory_order_release);
+        event = OrderCacheEvent{};
+        return true;
+    }
+
+    if (!m_queue.tryPop(item)) {
+        return false;
+    }
+    if (!item.matchingSize) {
+        event = std::move(item.event);
+        return true;
+    }
+
+    // Clearing the flag first means a change published from here on queues the slot again. The exchange reads the
+    // publisher's last exchange, so the load below sees at least the value that queued it.
+    auto& slot = *item.matchingSize;
+    slot.queued.exchange(false, std::memory_order_acq_rel);
+    event = OrderCacheEvent{};
+    event.type = OrderCacheEvent::Type::MATCHING_SIZE_CHANGED;
+    event.securityId = slot.securityId;
+    event.qty = slot.matchingSize.load(std::memory_order_relaxed);
+    return true;
+}
+
+void OrderCacheSubscription::publish(const OrderCacheEvent& event) {
+    if (m_resync.load(std::memory_order_acquire)) {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!m_queue.tryPush(Item{event, nullptr})) {
+        overflow();
+    }
+}
+
+void OrderCacheSubscription::publishMatchingSize(SymbolId securityId, std::string_view securityName,
+                                                 unsigned int matchingSize) {
+    auto [slotIt, inserted] = m_slotBySecurity.try_emplace(securityId, nullptr);
+    if (inserted) {
+        slotIt->second = newSlot(securityName);
+    }
+    auto& slot = *slotIt->second;
+    slot.matchingSize.store(matchingSize, std::memory_order_relaxed);
+
+    // the subscriber resynchronizes from a query anyway
+    if (m_resync.load(std::memory_order_acquire)) {
+        return;
+    }
+    // already queued: the subscriber will read the value just stored
+    if (slot.queued.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    if (!m_queue.tryPush(Item{{}, &slot})) {
+        slot.queued.store(false, std::memory_order_relaxed);
+        overflow();
+    }
+}
+
+void OrderCacheSubscription::publishResync() {
+    // symbol ids are about to change meaning; slots still queued stay valid until the subscriber drains them
+    for (const auto& [securityId, slot] : m_slotBySecurity) {
+        m_retiredSlots.push_back(slot);
+    }
+    m_slotBySecurity.clear();
+    m_resync.store(true, std::memory_order_release);
+}
+
+OrderCacheSubscription::MatchingSizeSlot* OrderCacheSubscription::newSlot(std::string_view securityId) {
+    // The flag reads clear once the subscriber has handled the resync that retired the slots, after draining every
+    // item queued before it, so nothing points to them anymore
+    if (m_retiredSlots.empty() || m_resync.load(std::memory_order_acquire)) {
+        return &m_slots.emplace_back(securityId);
+    }
+    auto* slot = m_retiredSlots.back();
+    m_retiredSlots.pop_back();
+    slot->securityId = securityId;
+    slot->matchingSize.store(0, std::memory_order_relaxed);
+    slot->queued.store(false, std::memory_order_relaxed);
+    return slot;
+}
+
+void OrderCacheSubscription::overflow() {
+    m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    m_resync.store(true, std::memory_order_release);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "MpscQueue.h"
+#include "OrderView.h"
+#include "SymbolTable.h"
+
+// A change made to an order cache, as delivered to its subscribers
+struct OrderCacheEvent {
+    enum class Type : uint8_t {
+        ORDER_ADDED = 0,
+        ORDER_CANCELLED,
+        // an amend or a partial fill; qty is the qty left resting
+        ORDER_QTY_CHANGED,
+        // one cancelOrdersForUser (user is set) or cancelOrdersForSecIdWithMinimumQty (securityId and qty, the
+        // minimum qty, are set) call; orderIds holds every order it cancelled
+        ORDERS_CANCELLED,
+        // qty is the latest matching size of securityId
+        MATCHING_SIZE_CHANGED,
+        // events were lost, because the queue was full or the cache was restored: resynchronize from a query
+        RESYNC,
+    };
+
+    Type type = Type::RESYNC;
+    std::string orderId;
+    std::string securityId;
+    OrderSide side = OrderSide::BUY;
+    unsigned int qty = 0;
+    std::string user;
+    std::string company;
+    std::vector<std::string> orderIds;
+};
+
+// The receiving end of a subscription to an order cache (see BasicOrderCache::subscribe). The cache publishes into a
+// bounded lock-free queue and never waits for the subscriber, who polls it from one thread.
+//
+// Matching sizes are coalesced per security: while a change of a security is still queued, later ones only update
+// the value it will deliver, so a slow subscriber gets the latest matching size instead of a backlog of stale ones.
+// Order events can't be coalesced: once the queue is full, events are dropped until the subscriber has drained what
+// is still queued, and it gets a single RESYNC in their place.
+class OrderCacheSubscription {
+   public:
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+    // capacity is rounded up to a power of two
+    explicit OrderCacheSubscription(size_t capacity = DEFAULT_CAPACITY);
+
+    OrderCacheSubscription(const OrderCacheSubscription&) = delete;
+    OrderCacheSubscription& operator=(const OrderCacheSubscription&) = delete;
+
+    // Subscriber only: takes the next event, returns false when there is none
+    bool poll(OrderCacheEvent& event);
+
+    // events dropped because the queue was full, since the subscription started
+    uint64_t droppedEvents() const { return m_droppedEvents.load(std::memory_order_relaxed); }
+
+    // Publisher only, the cache under its exclusive lock
+    void publish(const OrderCacheEvent& event);
+    void publishMatchingSize(SymbolId securityId, std::string_view securityName, unsigned int matchingSize);
+    // the cache's symbol ids are about to be reassigned
+    void publishResync();
+
+   private:
+    // the latest matching size of one security, queued at most once at a time
+    struct MatchingSizeSlot {
+        explicit MatchingSizeSlot(std::string_view securityId) : securityId(securityId) {}
+
+        // only rewritten when the slot is reused, which the subscriber can't see
+        std::string securityId;
+        std::atomic<unsigned int> matchingSize{0};
+        std::atomic<bool> queued{false};
+    };
+
+    // either an order event or a matching size slot
+    struct Item {
+        OrderCacheEvent event;
+        MatchingSizeSlot* matchingSize = nullptr;
+    };
+
+    // events are being lost until the subscriber catches up
+    void overflow();
+    MatchingSizeSlot* newSlot(std::string_view securityId);
+
+    MpscQueue<Item> m_queue;
+    // Publisher only. A deque never moves its elements, so queued items can point to them. The slots a resync retires
+    // are reused for new securities once the subscriber has handled it, rather than piling up across restores.
+    std::deque<MatchingSizeSlot> m_slots;
+    FlatHashMap<SymbolId, MatchingSizeSlot*> m_slotBySecurity;
+    std::vector<MatchingSizeSlot*> m_retiredSlots;
+    // set by the publisher when it loses an event, cleared by the subscriber once it has drained the queue
+    std::atomic<bool> m_resync{false};
+    std::atomic<uint64_t> m_droppedEvents{0};
+};
@@ -1,8 +1,30 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
+#include "FlatHashMap.h"
 #include "OrderCache.h"
+#include "OrderFeed.h"
+#include "OrderGenerator.h"
+#include "PipelinedOrderCache.h"
+#include "ShardedOrderCache.h"
+#include "SharedMemoryOrderCache.h"
 #include "gtest/gtest.h"
 
 TEST(OrderCacheTest, AddOrder) {
@@ -30,6 +52,31 @@ TEST(OrderCacheTest, GetAllOrders) {
     ASSERT_EQ(allOrders.size(), 2);
 }
 
+TEST(OrderCacheTest, GetAllOrdersRestoresFields) {
+    OrderCache cache;
+    cache.addOrder(Order{"1", "SecId1", "BUY", 100, "User1", "Company1"});
+    cache.addOrder(Order{"2", "SecId2", "sell", 200, "User1", "Company2"});
+
+    std::vector<Order> allOrders = cache.getAllOrders();
+    ASSERT_EQ(allOrders.size(), 2);
+    std::sort(allOrders.begin(), allOrders.end(),
+              [](const Order& lhs, const Order& rhs) { return lhs.orderId() < rhs.orderId(); });
+
+    ASSERT_EQ(allOrders[0].orderId(), "1");
+    ASSERT_EQ(allOrders[0].securityId(), "SecId1");
+    ASSERT_EQ(allOrders[0].side(), "Buy");
+    ASSERT_EQ(allOrders[0].qty(), 100);
+    ASSERT_EQ(allOrders[0].user(), "User1");
+    ASSERT_EQ(allOrders[0].company(), "Company1");
+
+    ASSERT_EQ(allOrders[1].orderId(), "2");
+    ASSERT_EQ(allOrders[1].securityId(), "SecId2");
+    ASSERT_EQ(allOrders[1].side(), "Sell");
+    ASSERT_EQ(allOrders[1].qty(), 200);
+    ASSERT_EQ(allOrders[1].user(), "User1");
+    ASSERT_EQ(allOrders[1].company(), "Company2");
+}
+
 TEST(OrderCacheTest, CancelOrder) {
     OrderCache cache;
     cache.addOrder(Order{"1", "SecId1", "BUY", 100, "User1", "Company1"});
@@ -50,6 +97,23 @@ TEST(OrderCacheTest, CancelOrder) {
     ASSERT_EQ(allOrders.size(), 0);
 }
 
+TEST(OrderCacheTest, LookupsByStringView) {
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "bUY", 300, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "SELL", 200, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 100, "User2", "CompanyB"});
+    ASSERT_THROW(cache.addOrder(Order{"OrdId4", "SecId1", "Buyer", 100, "User2", "CompanyB"}), std::exception);
+
+    // views into a larger buffer, not null-terminated
+    const std::string buffer = "OrdId2,SecId1,User1";
+    ASSERT_EQ(cache.getMatchingSizeForSecurity(std::string_view(buffer).substr(7, 6)), 300);
+    cache.cancelOrder(std::string_view(buffer).substr(0, 6));
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 100);
+    cache.cancelOrdersForUser(std::string_view(buffer).substr(14));
+    ASSERT_EQ(cache.getAllOrders().size(), 1);
+    ASSERT_EQ(cache.getAllOrders()[0].orderId(), "OrdId3");
+}
+
 TEST(OrderCacheTest, CancelOrdersForUser) {
     OrderCache cache;
     cache.addOrder(Order{"1", "SecId1", "BUY", 100, "User1", "Company1"});
@@ -89,6 +153,75 @@ TEST(OrderCacheTest, CancelOrdersForSecIdWithMinimumQty) {
     ASSERT_EQ(allOrders.size(), 0);
 }
 
+TEST(OrderCacheTest, GetOrdersForSecIdWithMinimumQty) {
+    OrderCache cache;
+    cache.addOrder(Order{"1", "SecId1", "BUY", 200, "User1", "Company1"});
+    cache.addOrder(Order{"2", "SecId1", "SELL", 200, "User2", "Company1"});
+    cache.addOrder(Order{"3", "SecId1", "BUY", 100, "User1", "Company1"});
+    cache.addOrder(Order{"4", "SecId2", "SELL", 500, "User2", "Company1"});
+
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId1", 300), 0);
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId1", 200), 2);
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId1", 0), 3);
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId3", 0), 0);
+
+    std::vector<Order> orders = cache.getOrdersForSecIdWithMinimumQty("SecId1", 150);
+    ASSERT_EQ(orders.size(), 2);
+    for (const auto& order : orders) {
+        ASSERT_EQ(order.qty(), 200);
+    }
+
+    // queries don't cancel anything
+    ASSERT_EQ(cache.getAllOrders().size(), 4);
+}
+
+TEST(OrderCacheTest, ForEachOrderWithFilters) {
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User1", "CompanyA"});
+
+    auto count = [&](const OrderFilter& filter) {
+        size_t visited = 0;
+        cache.forEachOrder([&](const OrderView& order) {
+            ASSERT_TRUE(filter.matches(order));
+            visited++;
+        }, filter);
+        return visited;
+    };
+    ASSERT_EQ(count({}), 4);
+    ASSERT_EQ(count({"SecId1", "", ""}), 2);
+    ASSERT_EQ(count({"", "User1", ""}), 2);
+    ASSERT_EQ(count({"", "", "CompanyA"}), 3);
+    ASSERT_EQ(count({"SecId2", "User1", "CompanyA"}), 1);
+    ASSERT_EQ(count({"SecId3", "", ""}), 0);
+}
+
+TEST(OrderCacheTest, SnapshotIsPointInTime) {
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+
+    const OrderSnapshot snapshot = cache.snapshot();
+    cache.cancelOrdersForUser("User1");
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"});
+
+    ASSERT_EQ(snapshot.size(), 2);
+    std::vector<std::string> orderIds;
+    snapshot.forEach([&](const OrderView& order) { orderIds.emplace_back(order.orderId); });
+    std::sort(orderIds.begin(), orderIds.end());
+    ASSERT_EQ(orderIds, (std::vector<std::string>{"OrdId1", "OrdId2"}));
+
+    const OrderSnapshot secIdSnapshot = cache.snapshot({"SecId1", "", ""});
+    ASSERT_EQ(secIdSnapshot.size(), 1);
+    ASSERT_EQ(secIdSnapshot[0].orderId, "OrdId3");
+    ASSERT_EQ(secIdSnapshot[0].side, OrderSide::SELL);
+    ASSERT_EQ(secIdSnapshot[0].qty, 500);
+    ASSERT_EQ(secIdSnapshot[0].user, "User3");
+    ASSERT_EQ(secIdSnapshot[0].company, "CompanyA");
+}
+
 TEST(OrderCacheTest, GetMatchingSizeForSecurityTest1) {
     OrderCache cache;
 
@@ -161,6 +294,1306 @@ TEST(OrderCacheTest, GetMatchingSizeForSecurityTest3) {
     ASSERT_EQ(matchingSize, 0);
 }
 
+TEST(OrderCacheTest, GetMatchingSizeForSecurityAfterCancels) {
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"});
+    cache.addOrder(Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"});
+    cache.addOrder(Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"});
+    cache.addOrder(Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+
+    cache.cancelOrder("OrdId7");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 700);
+
+    cache.cancelOrdersForUser("User8");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 600);
+
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 3000);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 0);
+
+    // re-adding an existing order id replaces the resting order
+    cache.addOrder(Order{"OrdId4", "SecId2", "Sell", 50, "User4", "CompanyC"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 50);
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+}
+
+TEST(OrderCacheTest, GetMatchingSizeForSecuritySplitsAcrossCompanies) {
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 200, "User1", "Company2"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Buy", 200, "User2", "Company1"});
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 100, "User3", "Company0"});
+    cache.addOrder(Order{"OrdId4", "SecId1", "Buy", 400, "User2", "Company1"});
+    cache.addOrder(Order{"OrdId5", "SecId1", "Sell", 500, "User2", "Company1"});
+
+    // Company2 crosses 200 against Company1 and Company1 crosses 100 against Company0
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 300);
+}
+
+// Matching size of one security straight from its orders: max flow from the buy orders to the sell orders of other
+// companies, with every order's qty as the capacity of its edge to the source or the sink
+static uint64_t maxFlowMatchingSize(const std::vector<Order>& orders, const std::string& securityId) {
+    std::vector<const Order*> buys;
+    std::vector<const Order*> sells;
+    for (const auto& order : orders) {
+        if (order.securityId() == securityId) {
+            (order.side() == "Buy" ? buys : sells).push_back(&order);
+        }
+    }
+
+    // node 0 is the source, then the buys, then the sells, then the sink
+    const size_t sink = buys.size() + sells.size() + 1;
+    std::vector<std::vector<uint64_t>> capacity(sink + 1, std::vector<uint64_t>(sink + 1, 0));
+    for (size_t b = 0; b < buys.size(); b++) {
+        capacity[0][1 + b] = buys[b]->qty();
+        for (size_t s = 0; s < sells.size(); s++) {
+            if (buys[b]->company() != sells[s]->company()) {
+                capacity[1 + b][1 + buys.size() + s] = UINT32_MAX;
+            }
+        }
+    }
+    for (size_t s = 0; s < sells.size(); s++) {
+        capacity[1 + buys.size() + s][sink] = sells[s]->qty();
+    }
+
+    // Edmonds-Karp
+    uint64_t flow = 0;
+    while (true) {
+        std::vector<size_t> parent(sink + 1, SIZE_MAX);
+        std::vector<size_t> queue{0};
+        parent[0] = 0;
+        for (size_t i = 0; i < queue.size() && parent[sink] == SIZE_MAX; i++) {
+            for (size_t next = 0; next <= sink; next++) {
+                if (parent[next] == SIZE_MAX && capacity[queue[i]][next] > 0) {
+                    parent[next] = queue[i];
+                    queue.push_back(next);
+                }
+            }
+        }
+        if (parent[sink] == SIZE_MAX) {
+            return flow;
+        }
+        uint64_t augment = UINT64_MAX;
+        for (size_t node = sink; node != 0; node = parent[node]) {
+            augment = std::min(augment, capacity[parent[node]][node]);
+        }
+        for (size_t node = sink; node != 0; node = parent[node]) {
+            capacity[parent[node]][node] -= augment;
+            capacity[node][parent[node]] += augment;
+        }
+        flow += augment;
+    }
+}
+
+TEST(OrderCacheTest, AggregatesMatchOrderLevelReference) {
+    std::mt19937 rng(18);
+    const std::vector<std::string> securities = {"SecId0", "SecId1", "SecId2"};
+    for (int book = 0; book < 50; book++) {
+        OrderCache cache;
+        const size_t companyCount = 1 + rng() % 5;
+        for (int op = 0; op < 60; op++) {
+            const auto orderId = "OrdId" + std::to_string(rng() % 20);
+            const auto& securityId = securities[rng() % securities.size()];
+            switch (rng() % 8) {
+                case 0:
+                    cache.cancelOrder(orderId);
+                    break;
+                case 1:
+                    cache.amendOrderQty(orderId, rng() % 500);
+                    break;
+                case 2:
+                    cache.reduceOrderQty(orderId, rng() % 300);
+                    break;
+                case 3:
+                    cache.cancelOrdersForSecIdWithMinimumQty(securityId, 400 + rng() % 200);
+                    break;
+                default:
+                    cache.addOrder(Order{orderId, securityId, rng() % 2 ? "Buy" : "Sell",
+                                         static_cast<unsigned int>(1 + rng() % 500),
+                                         "User" + std::to_string(rng() % 4),
+                                         "Company" + std::to_string(rng() % companyCount)});
+            }
+
+            const auto orders = cache.getAllOrders();
+            std::map<std::tuple<std::string, std::string, std::string>, uint64_t> userQty;
+            std::map<std::tuple<std::string, std::string, std::string>, uint64_t> companyQty;
+            for (const auto& order : orders) {
+                userQty[{order.user(), order.securityId(), order.side()}] += order.qty();
+                companyQty[{order.company(), order.securityId(), order.side()}] += order.qty();
+            }
+            for (const auto& id : securities) {
+                ASSERT_EQ(cache.getMatchingSizeForSecurity(id), maxFlowMatchingSize(orders, id))
+                    << "book " << book << ", op " << op << ", " << id;
+                for (size_t owner = 0; owner < 5; owner++) {
+                    const auto user = "User" + std::to_string(owner);
+                    const auto company = "Company" + std::to_string(owner);
+                    ASSERT_EQ(cache.getOpenQtyForUser(user, id, OrderSide::BUY), (userQty[{user, id, "Buy"}]));
+                    ASSERT_EQ(cache.getOpenQtyForUser(user, id, OrderSide::SELL), (userQty[{user, id, "Sell"}]));
+                    ASSERT_EQ(cache.getOpenQtyForCompany(company, id, OrderSide::BUY),
+                              (companyQty[{company, id, "Buy"}]));
+                    ASSERT_EQ(cache.getOpenQtyForCompany(company, id, OrderSide::SELL),
+                              (companyQty[{company, id, "Sell"}]));
+                }
+            }
+        }
+    }
+}
+
+TEST(OrderCacheTest, GetMatchingSizesForAllSecurities) {
+    OrderCache cache;
+    ShardedOrderCache shardedCache(4);
+    OrderGenerator generator(10000, 4);
+    auto orders = generator.generate(40000);
+    cache.addOrders(orders);
+    shardedCache.addOrders(orders);
+    cache.cancelOrdersForSecIdWithMinimumQty(OrderGenerator::securityName(7), 0);
+    shardedCache.cancelOrdersForSecIdWithMinimumQty(OrderGenerator::securityName(7), 0);
+
+    const auto sizes = cache.getMatchingSizesForAllSecurities(4);
+    const auto serialSizes = cache.getMatchingSizesForAllSecurities(1);
+    ASSERT_EQ(sizes.size(), serialSizes.size());
+    for (size_t i = 0; i < sizes.size(); i++) {
+        ASSERT_EQ(sizes[i].securityId, serialSizes[i].securityId);
+        ASSERT_EQ(sizes[i].matchingSize, serialSizes[i].matchingSize);
+    }
+    for (const auto& [securityId, matchingSize] : sizes) {
+        ASSERT_NE(securityId, OrderGenerator::securityName(7));
+        ASSERT_EQ(matchingSize, cache.getMatchingSizeForSecurity(securityId));
+    }
+
+    auto shardedSizes = shardedCache.getMatchingSizesForAllSecurities(4);
+    ASSERT_EQ(shardedSizes.size(), sizes.size());
+    for (const auto& [securityId, matchingSize] : shardedSizes) {
+        ASSERT_EQ(matchingSize, cache.getMatchingSizeForSecurity(securityId));
+    }
+}
+
+TEST(OrderCacheTest, AmendAndReduceOrderQty) {
+    OrderCache cache;
+    ShardedOrderCache shardedCache(4);
+    PipelinedOrderCache pipelinedCache;
+    for (OrderCacheInterface* target : std::vector<OrderCacheInterface*>{&cache, &shardedCache, &pipelinedCache}) {
+        target->addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        target->addOrder(Order{"OrdId2", "SecId1", "Sell", 600, "User2", "CompanyB"});
+        target->addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+        target->addOrder(Order{"OrdId4", "SecId1", "Buy", 200, "User4", "CompanyB"});
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 900);
+
+        target->amendOrderQty("OrdId3", 900);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 1200);
+        ASSERT_EQ(target->countOrdersForSecIdWithMinimumQty("SecId1", 700), 2);
+
+        // a partial fill, then one taking the rest, which cancels the order
+        target->reduceOrderQty("OrdId1", 400);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 800);
+        target->reduceOrderQty("OrdId2", 1000);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 800);
+        ASSERT_EQ(target->countOrdersForSecIdWithMinimumQty("SecId1", 0), 3);
+        target->amendOrderQty("OrdId4", 0);
+        target->amendOrderQty("OrdId9", 100);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 600);
+
+        auto orders = target->getAllOrders();
+        std::sort(orders.begin(), orders.end(),
+                  [](const Order& lhs, const Order& rhs) { return lhs.orderId() < rhs.orderId(); });
+        ASSERT_EQ(orders.size(), 2);
+        ASSERT_EQ(orders[0].orderId(), "OrdId1");
+        ASSERT_EQ(orders[0].qty(), 600);
+        ASSERT_EQ(orders[1].orderId(), "OrdId3");
+        ASSERT_EQ(orders[1].qty(), 900);
+        ASSERT_EQ(orders[1].user(), "User3");
+
+        // the order id is free again once the order is gone
+        target->addOrder(Order{"OrdId2", "SecId1", "Buy", 100, "User2", "CompanyB"});
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 700);
+    }
+}
+
+// Implements only what OrderCacheInterface requires, so everything else goes through its defaults
+class MinimalOrderCache : public OrderCacheInterface {
+   public:
+    void addOrder(Order order) override {
+        cancelOrder(order.orderId());
+        m_orders.push_back(std::move(order));
+    }
+    void cancelOrder(std::string_view orderId) override {
+        eraseIf([&](const Order& order) { return order.orderId() == orderId; });
+    }
+    void cancelOrdersForUser(std::string_view user) override {
+        eraseIf([&](const Order& order) { return order.user() == user; });
+    }
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) override {
+        eraseIf([&](const Order& order) { return order.securityId() == securityId && order.qty() >= minQty; });
+    }
+    unsigned int getMatchingSizeForSecurity(std::string_view) override { return 0; }
+    std::vector<Order> getAllOrders() const override { return m_orders; }
+
+   private:
+    template <typename Predicate>
+    void eraseIf(Predicate predicate) {
+        m_orders.erase(std::remove_if(m_orders.begin(), m_orders.end(), predicate), m_orders.end());
+    }
+
+    std::vector<Order> m_orders;
+};
+
+TEST(OrderCacheTest, GetOpenQtyForUserAndCompany) {
+    OrderCache cache;
+    ShardedOrderCache shardedCache(4);
+    PipelinedOrderCache pipelinedCache;
+    MinimalOrderCache minimalCache;
+    for (OrderCacheInterface* target :
+         std::vector<OrderCacheInterface*>{&cache, &shardedCache, &pipelinedCache, &minimalCache}) {
+        // the pipelined cache answers open qty queries without waiting for its queue
+        const auto applied = [&] {
+            if (target == &pipelinedCache) {
+                pipelinedCache.flush().wait();
+            }
+        };
+        target->addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        target->addOrder(Order{"OrdId2", "SecId1", "Buy", 300, "User2", "CompanyA"});
+        target->addOrder(Order{"OrdId3", "SecId1", "Sell", 200, "User1", "CompanyA"});
+        target->addOrder(Order{"OrdId4", "SecId2", "Buy", 500, "User1", "CompanyB"});
+        applied();
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId1", OrderSide::BUY), 1000);
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId1", OrderSide::SELL), 200);
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId2", OrderSide::BUY), 500);
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyA", "SecId1", OrderSide::BUY), 1300);
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyB", "SecId1", OrderSide::BUY), 0);
+        ASSERT_EQ(target->getOpenQtyForUser("User9", "SecId1", OrderSide::BUY), 0);
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId9", OrderSide::BUY), 0);
+
+        target->amendOrderQty("OrdId1", 400);
+        target->reduceOrderQty("OrdId2", 100);
+        applied();
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId1", OrderSide::BUY), 400);
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyA", "SecId1", OrderSide::BUY), 600);
+
+        target->cancelOrdersForSecIdWithMinimumQty("SecId1", 300);
+        applied();
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyA", "SecId1", OrderSide::BUY), 200);
+        target->cancelOrdersForUser("User1");
+        applied();
+        ASSERT_EQ(target->getOpenQtyForUser("User1", "SecId1", OrderSide::SELL), 0);
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyB", "SecId2", OrderSide::BUY), 0);
+
+        // a reused order id moves its qty to the new owner
+        target->addOrder(Order{"OrdId2", "SecId1", "Sell", 700, "User3", "CompanyB"});
+        applied();
+        ASSERT_EQ(target->getOpenQtyForUser("User2", "SecId1", OrderSide::BUY), 0);
+        ASSERT_EQ(target->getOpenQtyForCompany("CompanyB", "SecId1", OrderSide::SELL), 700);
+    }
+}
+
+TEST(OrderCacheTest, GetOpenQtyReadsConcurrentlyWithWriters) {
+    OrderCache cache;
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    std::atomic<size_t> badReads{0};
+    for (int r = 0; r < 2; r++) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                // every user has at most 10 resting orders of 100 on each security
+                for (int user = 0; user < 160; user++) {
+                    const auto qty = cache.getOpenQtyForUser("User" + std::to_string(user), "SecId1", OrderSide::BUY);
+                    if (qty % 100 != 0 || qty > 1000) {
+                        badReads++;
+                    }
+                }
+            }
+        });
+    }
+
+    // enough distinct users and securities to grow the index while it is being read
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 400; i++) {
+            cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(i % 40), "Buy", 100,
+                                 "User" + std::to_string(i % 8 + round * 8), "Company" + std::to_string(i % 3)});
+        }
+        for (int user = 0; user < 8; user++) {
+            cache.cancelOrdersForUser("User" + std::to_string(user + round * 8));
+        }
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(badReads, 0);
+    ASSERT_EQ(cache.getOpenQtyForUser("User0", "SecId1", OrderSide::BUY), 0);
+}
+
+static std::vector<OrderCacheEvent> pollAll(OrderCacheSubscription& subscription) {
+    std::vector<OrderCacheEvent> events;
+    for (OrderCacheEvent event; subscription.poll(event);) {
+        events.push_back(std::move(event));
+    }
+    return events;
+}
+
+TEST(OrderCacheTest, SubscriptionDeliversOrderAndMatchingSizeEvents) {
+    using Type = OrderCacheEvent::Type;
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 300, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 500, "User2", "CompanyB"});
+
+    auto subscription = cache.subscribe();
+    ASSERT_TRUE(pollAll(*subscription).empty());
+
+    cache.addOrder(Order{"OrdId3", "SecId2", "Buy", 100, "User1", "CompanyA"});
+    auto events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].type, Type::ORDER_ADDED);
+    ASSERT_EQ(events[0].orderId, "OrdId3");
+    ASSERT_EQ(events[0].securityId, "SecId2");
+    ASSERT_EQ(events[0].side, OrderSide::BUY);
+    ASSERT_EQ(events[0].qty, 100);
+    ASSERT_EQ(events[0].user, "User1");
+    ASSERT_EQ(events[0].company, "CompanyA");
+
+    cache.amendOrderQty("OrdId2", 200);
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].type, Type::ORDER_QTY_CHANGED);
+    ASSERT_EQ(events[0].qty, 200);
+    ASSERT_EQ(events[1].type, Type::MATCHING_SIZE_CHANGED);
+    ASSERT_EQ(events[1].securityId, "SecId1");
+    ASSERT_EQ(events[1].qty, 200);
+
+    // the matching size known when subscribing is the baseline
+    cache.cancelOrder("OrdId1");
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].type, Type::ORDER_CANCELLED);
+    ASSERT_EQ(events[0].orderId, "OrdId1");
+    ASSERT_EQ(events[1].type, Type::MATCHING_SIZE_CHANGED);
+    ASSERT_EQ(events[1].qty, 0);
+
+    // nothing changes, nothing is published
+    cache.cancelOrder("OrdId9");
+    cache.amendOrderQty("OrdId2", 200);
+    ASSERT_TRUE(pollAll(*subscription).empty());
+
+    cache.unsubscribe(subscription);
+    cache.addOrder(Order{"OrdId4", "SecId1", "Buy", 100, "User1", "CompanyA"});
+    ASSERT_TRUE(pollAll(*subscription).empty());
+}
+
+TEST(OrderCacheTest, SubscriptionBatchesMassCancels) {
+    using Type = OrderCacheEvent::Type;
+    OrderCache cache;
+    auto subscription = cache.subscribe();
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 300, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 500, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId3", "SecId2", "Sell", 100, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 400, "User2", "CompanyB"});
+    cache.addOrder(Order{"OrdId5", "SecId1", "Sell", 700, "User1", "CompanyA"});
+    pollAll(*subscription);
+
+    cache.cancelOrdersForUser("User1");
+    auto events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 3);
+    ASSERT_EQ(events[0].type, Type::ORDERS_CANCELLED);
+    ASSERT_EQ(events[0].user, "User1");
+    std::sort(events[0].orderIds.begin(), events[0].orderIds.end());
+    ASSERT_EQ(events[0].orderIds, (std::vector<std::string>{"OrdId1", "OrdId3", "OrdId5"}));
+    std::map<std::string, unsigned int> matchingSizes;
+    for (size_t i = 1; i < events.size(); i++) {
+        ASSERT_EQ(events[i].type, Type::MATCHING_SIZE_CHANGED);
+        matchingSizes[events[i].securityId] = events[i].qty;
+    }
+    ASSERT_EQ(matchingSizes, (std::map<std::string, unsigned int>{{"SecId1", 0}, {"SecId2", 0}}));
+
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 1000);
+    ASSERT_TRUE(pollAll(*subscription).empty());
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId1", 100);
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].type, Type::ORDERS_CANCELLED);
+    ASSERT_EQ(events[0].securityId, "SecId1");
+    ASSERT_EQ(events[0].qty, 100);
+    ASSERT_EQ(events[0].orderIds, std::vector<std::string>{"OrdId2"});
+}
+
+TEST(OrderCacheTest, SubscriptionCoalescesMatchingSizes) {
+    using Type = OrderCacheEvent::Type;
+    OrderCache cache;
+    auto subscription = cache.subscribe();
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 1000, "User2", "CompanyB"});
+    for (unsigned int qty = 999; qty > 500; qty--) {
+        cache.amendOrderQty("OrdId1", qty);
+    }
+
+    // the matching size was queued once, by the second add, and delivers the latest value
+    const auto events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 2 + 499 + 1);
+    ASSERT_EQ(std::count_if(events.begin(), events.end(),
+                            [](const auto& event) { return event.type == Type::MATCHING_SIZE_CHANGED; }),
+              1);
+    ASSERT_EQ(events[2].type, Type::MATCHING_SIZE_CHANGED);
+    ASSERT_EQ(events[2].qty, 501);
+    ASSERT_EQ(subscription->droppedEvents(), 0);
+}
+
+TEST(OrderCacheTest, SubscriberKeepsUpWithConcurrentWriters) {
+    using Type = OrderCacheEvent::Type;
+    OrderCache cache;
+    auto subscription = cache.subscribe(64);
+    std::atomic<bool> done{false};
+    std::map<std::string, unsigned int> matchingSizes;
+    size_t resyncs = 0;
+    std::thread subscriber([&] {
+        auto resync = [&] {
+            resyncs++;
+            for (int sec = 0; sec < 8; sec++) {
+                const auto securityId = "SecId" + std::to_string(sec);
+                matchingSizes[securityId] = cache.getMatchingSizeForSecurity(securityId);
+            }
+        };
+        // once the writers are done, one more pass drains what they published last
+        for (bool finished = false; !finished;) {
+            finished = done.load();
+            for (OrderCacheEvent event; subscription->poll(event);) {
+                if (event.type == Type::RESYNC) {
+                    resync();
+                } else if (event.type == Type::MATCHING_SIZE_CHANGED) {
+                    matchingSizes[event.securityId] = event.qty;
+                }
+            }
+        }
+    });
+
+    std::mt19937 rng(7);
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; w++) {
+        writers.emplace_back([&cache, w, seed = rng()] {
+            std::mt19937 writerRng(seed);
+            for (int i = 0; i < 5000; i++) {
+                const auto orderId = "OrdId" + std::to_string(w) + "_" + std::to_string(writerRng() % 500);
+                if (writerRng() % 4 == 0) {
+                    cache.cancelOrder(orderId);
+                } else {
+                    const auto securityId = "SecId" + std::to_string(writerRng() % 8);
+                    const auto side = writerRng() % 2 ? "Sell" : "Buy";
+                    const auto qty = static_cast<unsigned int>(writerRng() % 1000);
+                    cache.addOrder(Order{orderId, securityId, side, qty, "User" + std::to_string(w),
+                                         "Company" + std::to_string(writerRng() % 4)});
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done = true;
+    subscriber.join();
+
+    for (int sec = 0; sec < 8; sec++) {
+        const auto securityId = "SecId" + std::to_string(sec);
+        ASSERT_EQ(matchingSizes[securityId], cache.getMatchingSizeForSecurity(securityId)) << securityId;
+    }
+}
+
+TEST(OrderCacheTest, CancelReusesOrderSlots) {
+    OrderCache cache;
+    for (int i = 0; i < 10000; i++) {
+        cache.addOrder(Order{std::to_string(i), "SecId" + std::to_string(i % 3), i % 2 ? "Sell" : "Buy", 100,
+                             "User" + std::to_string(i % 7), "Company" + std::to_string(i % 5)});
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        cache.cancelOrder(std::to_string(i));
+    }
+    cache.cancelOrdersForUser("User3");
+    for (int i = 10000; i < 12000; i++) {
+        cache.addOrder(Order{std::to_string(i), "SecId0", "Buy", 100, "User3", "Company0"});
+    }
+
+    std::vector<Order> allOrders = cache.getAllOrders();
+    size_t expectedSize = 2000;
+    for (int i = 1; i < 10000; i += 2) {
+        expectedSize += (i % 7 != 3);
+    }
+    ASSERT_EQ(allOrders.size(), expectedSize);
+    for (const auto& order : allOrders) {
+        const int id = std::stoi(order.orderId());
+        ASSERT_TRUE(id >= 10000 || (id % 2 == 1 && order.user() != "User3"));
+        ASSERT_EQ(order.securityId(), id >= 10000 ? "SecId0" : "SecId" + std::to_string(id % 3));
+    }
+
+    cache.cancelOrdersForUser("User3");
+    ASSERT_EQ(cache.getAllOrders().size(), expectedSize - 2000);
+}
+
+TEST(FlatHashMapTest, MatchesUnorderedMap) {
+    // few distinct keys, so inserts keep landing on tombstones and erased slots
+    FlatHashMap<uint64_t, uint64_t> map;
+    std::unordered_map<uint64_t, uint64_t> expected;
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 200000; i++) {
+        const uint64_t key = rng() % (i < 100000 ? 5000 : 50);
+        switch (rng() % 4) {
+            case 0:
+            case 1: {
+                const auto [it, inserted] = map.try_emplace(key, i);
+                ASSERT_EQ(inserted, expected.try_emplace(key, i).second);
+                ASSERT_EQ(it->first, key);
+                break;
+            }
+            case 2:
+                ASSERT_EQ(map.erase(key), expected.erase(key));
+                break;
+            case 3: {
+                const auto it = map.find(key);
+                const auto expectedIt = expected.find(key);
+                ASSERT_EQ(it == map.end(), expectedIt == expected.end());
+                if (expectedIt != expected.end()) {
+                    ASSERT_EQ(it->second, expectedIt->second);
+                    map.erase(it);
+                    expected.erase(expectedIt);
+                }
+                break;
+            }
+        }
+        ASSERT_EQ(map.size(), expected.size());
+    }
+
+    size_t visited = 0;
+    for (const auto& [key, value] : map) {
+        ASSERT_EQ(expected.at(key), value);
+        visited++;
+    }
+    ASSERT_EQ(visited, expected.size());
+    // shrinking back to a few keys doesn't leave the table full of tombstones
+    ASSERT_LE(map.capacity(), 16384);
+
+    auto copy = map;
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(map.begin(), map.end());
+    ASSERT_EQ(copy.size(), expected.size());
+    for (const auto& [key, value] : expected) {
+        ASSERT_EQ(copy[key], value);
+    }
+}
+
+TEST(FlatHashMapTest, StringViewKeys) {
+    std::vector<std::string> ids;
+    for (int i = 0; i < 10000; i++) {
+        ids.push_back("OrdId" + std::to_string(i));
+    }
+    FlatHashMap<std::string_view, size_t> map;
+    map.reserve(ids.size());
+    const auto capacity = map.capacity();
+    for (size_t i = 0; i < ids.size(); i++) {
+        ASSERT_TRUE(map.emplace(ids[i], i).second);
+    }
+    ASSERT_EQ(map.capacity(), capacity);
+    ASSERT_FALSE(map.emplace(ids[42], 0).second);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ASSERT_EQ(map.find(std::string("OrdId") + std::to_string(i))->second, i);
+    }
+    ASSERT_EQ(map.count("OrdId10000"), 0);
+}
+
+TEST(OrderCacheTest, LatencyHistogramPercentiles) {
+    // every value lands in a bucket whose upper bound is within 1/16 above it
+    for (const uint64_t ns : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull}) {
+        const auto bucket = LatencyHistogram::bucketFor(ns);
+        ASSERT_GE(LatencyHistogram::bucketUpperBound(bucket), ns);
+        ASSERT_LE(LatencyHistogram::bucketUpperBound(bucket), ns + ns / 16);
+        ASSERT_TRUE(bucket == 0 || LatencyHistogram::bucketUpperBound(bucket - 1) < ns);
+    }
+
+    LatencyHistogram histogram;
+    ASSERT_EQ(histogram.percentileNs(0.5), 0);
+    for (uint64_t ns = 1; ns <= 1000; ns++) {
+        histogram.record(ns);
+    }
+    ASSERT_EQ(histogram.count(), 1000);
+    ASSERT_EQ(histogram.maxNs(), 1000);
+    ASSERT_DOUBLE_EQ(histogram.meanNs(), 500.5);
+    ASSERT_GE(histogram.percentileNs(0.5), 500);
+    ASSERT_LE(histogram.percentileNs(0.5), 500 + 500 / 16);
+    ASSERT_GE(histogram.percentileNs(0.99), 990);
+    ASSERT_EQ(histogram.percentileNs(1), 1000);
+}
+
+TEST(OrderCacheTest, InstrumentedCacheStats) {
+    InstrumentedOrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 300, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 200, "User2", "CompanyB"});
+    std::thread([&cache]() {
+        cache.addOrder(Order{"OrdId3", "SecId2", "Sell", 100, "User3", "CompanyA"});
+        cache.cancelOrder("OrdId3");
+    }).join();
+    cache.addOrder(Order{"OrdId4", "SecId2", "Buy", 100, "User3", "CompanyC"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 200);
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId1", 0), 2);
+
+    // counts from both threads are merged
+    const auto report = cache.stats();
+    ASSERT_EQ(report.ops[static_cast<size_t>(CacheOp::ADD_ORDER)].count(), 4);
+    ASSERT_EQ(report.ops[static_cast<size_t>(CacheOp::CANCEL_ORDER)].count(), 1);
+    ASSERT_EQ(report.ops[static_cast<size_t>(CacheOp::GET_MATCHING_SIZE_FOR_SECURITY)].count(), 1);
+    ASSERT_EQ(report.ops[static_cast<size_t>(CacheOp::GET_ALL_ORDERS)].count(), 0);
+    ASSERT_EQ(report.lockHold[static_cast<size_t>(LockMode::EXCLUSIVE)].count(), 5);
+    ASSERT_EQ(report.lockHold[static_cast<size_t>(LockMode::SHARED)].count(), 2);
+    ASSERT_EQ(report.lockWait[static_cast<size_t>(LockMode::SHARED)].count(), 2);
+
+    ASSERT_EQ(report.orderCount, 3);
+    ASSERT_EQ(report.securityCount, 2);
+    ASSERT_EQ(report.userCount, 3);
+    ASSERT_EQ(report.companyCount, 3);
+    ASSERT_GE(report.orderPoolCapacity, 3);
+    auto ordersPerSecurity = report.ordersPerSecurity;
+    std::sort(ordersPerSecurity.begin(), ordersPerSecurity.end());
+    ASSERT_EQ(ordersPerSecurity, (std::vector<std::pair<std::string_view, size_t>>{{"SecId1", 2}, {"SecId2", 1}}));
+
+    std::ostringstream out;
+    report.print(out);
+    ASSERT_NE(out.str().find("addOrder"), std::string::npos);
+    ASSERT_NE(out.str().find("SecId1: 2 orders"), std::string::npos);
+
+    // an uninstrumented cache only reports the gauges
+    OrderCache plainCache;
+    plainCache.addOrder(Order{"OrdId1", "SecId1", "Buy", 300, "User1", "CompanyA"});
+    const auto plainReport = plainCache.stats();
+    ASSERT_EQ(plainReport.ops[static_cast<size_t>(CacheOp::ADD_ORDER)].count(), 0);
+    ASSERT_EQ(plainReport.orderCount, 1);
+}
+
+TEST(OrderCacheTest, StatsDumperPrintsPeriodically) {
+    InstrumentedOrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 300, "User1", "CompanyA"});
+
+    std::ostringstream out;
+    {
+        StatsDumper dumper([&cache]() { return cache.stats(); }, std::chrono::milliseconds(1), out);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    ASSERT_NE(out.str().find("orders: 1"), std::string::npos);
+}
+
+// orders of a cache, one line each, sorted
+template <typename Cache>
+static std::vector<std::string> describeOrders(const Cache& cache) {
+    std::vector<std::string> lines;
+    cache.forEachOrder([&](const OrderView& order) {
+        std::ostringstream line;
+        line << order.orderId << ' ' << order.securityId << ' ' << OrderCache::sideName(order.side) << ' '
+             << order.qty << ' ' << order.user << ' ' << order.company;
+        lines.push_back(line.str());
+    });
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+static std::filesystem::path makeTempDirectory() {
+    std::string pattern = (std::filesystem::temp_directory_path() / "order_cache_XXXXXX").string();
+    return mkdtemp(pattern.data());
+}
+
+TEST(OrderCacheTest, RestoreFromSnapshotAndJournalTail) {
+    const auto directory = makeTempDirectory();
+    OrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.enableJournal(directory.string(), 4);
+    for (int i = 2; i <= 20; i++) {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId" + std::to_string(i % 3), i % 2 ? "Sell" : "Buy",
+                             100u * i, "User" + std::to_string(i % 4), "Company" + std::to_string(i % 5)});
+    }
+    cache.cancelOrder("OrdId4");
+    cache.checkpoint();
+
+    // the journal tail after the checkpoint
+    cache.addOrder(Order{"OrdId21", "SecId4", "Sell", 300, "User9", "CompanyB"});
+    cache.addOrder(Order{"OrdId5", "SecId4", "Buy", 700, "User8", "CompanyA"});
+    cache.cancelOrder("OrdId6");
+    cache.amendOrderQty("OrdId7", 50);
+    cache.reduceOrderQty("OrdId8", 300);
+    cache.reduceOrderQty("OrdId9", 900);
+    cache.cancelOrdersForUser("User1");
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 1400);
+    cache.syncJournal();
+
+    OrderCache restored;
+    restored.restore(directory.string());
+    ASSERT_EQ(describeOrders(restored), describeOrders(cache));
+    for (const auto* securityId : {"SecId0", "SecId1", "SecId2", "SecId4"}) {
+        ASSERT_EQ(restored.getMatchingSizeForSecurity(securityId), cache.getMatchingSizeForSecurity(securityId));
+    }
+
+    // the restored cache carries on journaling into the same directory
+    // restoring again replaces the open qty instead of adding to it
+    restored.restore(directory.string());
+    ASSERT_EQ(restored.getOpenQtyForCompany("CompanyA", "SecId4", OrderSide::BUY), 700);
+
+    restored.enableJournal(directory.string());
+    restored.cancelOrder("OrdId21");
+    restored.syncJournal();
+    OrderCache restoredTwice;
+    restoredTwice.restore(directory.string());
+    ASSERT_EQ(describeOrders(restoredTwice), describeOrders(restored));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderCacheTest, RestoreStopsAtTornJournalTail) {
+    const auto directory = makeTempDirectory();
+    {
+        OrderCache cache;
+        cache.enableJournal(directory.string(), 1);
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "CompanyA"});
+        cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 200, "User2", "CompanyB"});
+        cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+    }
+
+    // simulate a crash in the middle of writing the last entry
+    for (const auto& file : std::filesystem::directory_iterator(directory)) {
+        if (file.path().extension() == ".log" && file.file_size() > 0) {
+            std::filesystem::resize_file(file.path(), file.file_size() - 3);
+        }
+    }
+
+    OrderCache restored;
+    restored.restore(directory.string());
+    const auto orders = describeOrders(restored);
+    ASSERT_EQ(orders.size(), 2);
+    ASSERT_EQ(orders[0], "OrdId1 SecId1 Buy 100 User1 CompanyA");
+    ASSERT_EQ(orders[1], "OrdId2 SecId1 Sell 200 User2 CompanyB");
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderCacheTest, FailedJournalWriteIsNeverReplayed) {
+    const auto directory = makeTempDirectory();
+    const auto segmentSize = [&] {
+        uintmax_t size = 0;
+        for (const auto& file : std::filesystem::directory_iterator(directory)) {
+            if (file.path().extension() == ".log") {
+                size = std::max(size, file.file_size());
+            }
+        }
+        return size;
+    };
+    {
+        OrderCache cache;
+        cache.enableJournal(directory.string(), 1);
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "CompanyA"});
+
+        // a file size limit a few bytes past the segment makes the next write partial, then fail
+        rlimit original;
+        ::getrlimit(RLIMIT_FSIZE, &original);
+        const auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+        rlimit limited = original;
+        limited.rlim_cur = static_cast<rlim_t>(segmentSize() + 10);
+        ::setrlimit(RLIMIT_FSIZE, &limited);
+        ASSERT_ANY_THROW(cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 200, "User2", "CompanyB"}));
+        ::setrlimit(RLIMIT_FSIZE, &original);
+        std::signal(SIGXFSZ, previousHandler);
+
+        ASSERT_EQ(describeOrders(cache), std::vector<std::string>{"OrdId1 SecId1 Buy 100 User1 CompanyA"});
+        cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+    }
+
+    OrderCache restored;
+    restored.restore(directory.string());
+    const auto orders = describeOrders(restored);
+    ASSERT_EQ(orders.size(), 2);
+    ASSERT_EQ(orders[0], "OrdId1 SecId1 Buy 100 User1 CompanyA");
+    ASSERT_EQ(orders[1], "OrdId3 SecId1 Sell 300 User3 CompanyC");
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderCacheTest, RestoreKeepsSymbolsWithoutOrders) {
+    const auto directory = makeTempDirectory();
+    {
+        OrderCache cache;
+        cache.enableJournal(directory.string(), 1);
+        cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "CompanyA"});
+        cache.addOrder(Order{"OrdId2", "SecId2", "Sell", 200, "User2", "CompanyB"});
+        cache.cancelOrder("OrdId2");
+        cache.checkpoint();
+        // replayed against a security the snapshot interned without orders
+        cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 0);
+    }
+
+    OrderCache restored;
+    restored.restore(directory.string());
+    ASSERT_EQ(restored.getMatchingSizeForSecurity("SecId2"), 0);
+    ASSERT_EQ(restored.countOrdersForSecIdWithMinimumQty("SecId2", 0), 0);
+    ASSERT_TRUE(restored.getOrdersForSecIdWithMinimumQty("SecId2", 0).empty());
+    ASSERT_EQ(restored.snapshot(OrderFilter{"SecId2", {}, {}}).size(), 0);
+    ASSERT_EQ(restored.snapshot(OrderFilter{{}, "User2", {}}).size(), 0);
+    restored.cancelOrdersForUser("User2");
+    restored.cancelOrdersForSecIdWithMinimumQty("SecId2", 0);
+    ASSERT_EQ(restored.getMatchingSizesForAllSecurities().size(), 1);
+    ASSERT_EQ(describeOrders(restored), std::vector<std::string>{"OrdId1 SecId1 Buy 100 User1 CompanyA"});
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderCacheTest, SubscriptionResyncsAfterOverflowAndRestore) {
+    using Type = OrderCacheEvent::Type;
+    OrderCache cache;
+    auto subscription = cache.subscribe(4);
+    for (int i = 0; i < 10; i++) {
+        cache.addOrder(Order{"OrdId" + std::to_string(i), "SecId1", i % 2 ? "Sell" : "Buy", 100, "User1",
+                             "Company" + std::to_string(i)});
+    }
+    auto events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].type, Type::RESYNC);
+    ASSERT_GT(subscription->droppedEvents(), 0);
+
+    // caught up: events flow again
+    cache.cancelOrder("OrdId0");
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[0].type, Type::ORDER_CANCELLED);
+    ASSERT_EQ(events[1].qty, 400);
+
+    const auto directory = makeTempDirectory();
+    cache.enableJournal(directory.string());
+    cache.addOrder(Order{"OrdId10", "SecId2", "Buy", 100, "User1", "CompanyA"});
+    pollAll(*subscription);
+    cache.restore(directory.string());
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 1);
+    ASSERT_EQ(events[0].type, Type::RESYNC);
+
+    // the restored matching size is the baseline, and goes through a slot the restore retired
+    cache.cancelOrder("OrdId2");
+    events = pollAll(*subscription);
+    ASSERT_EQ(events.size(), 2);
+    ASSERT_EQ(events[1].type, Type::MATCHING_SIZE_CHANGED);
+    ASSERT_EQ(events[1].securityId, "SecId1");
+    ASSERT_EQ(events[1].qty, 300);
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderFeedTest, CsvAndBinaryFeedsReplayTheSameEvents) {
+    const auto directory = makeTempDirectory();
+    const auto csvPath = (directory / "feed.csv").string();
+    const auto binaryPath = (directory / "feed.bin").string();
+    // example 1 of main.cpp, then cancels and amends; CRLF endings and no final newline on purpose
+    writeFileAtomically(csvPath,
+                        "timestamp_ns,type,order_id,security_id,side,qty,user,company\r\n"
+                        "# a comment, with commas\r\n"
+                        "1000,ADD,OrdId1,SecId1,Buy,1000,User1,CompanyA\r\n"
+                        "2000,ADD,OrdId2,SecId2,Sell,3000,User2,CompanyB\r\n"
+                        "\r\n"
+                        "3000,ADD,OrdId3,SecId1,Sell,500,User3,CompanyA\n"
+                        "4000,ADD,OrdId4,SecId2,Buy,600,User4,CompanyC\n"
+                        "5000,ADD,OrdId5,SecId2,Buy,100,User5,CompanyB\n"
+                        "6000,ADD,OrdId6,SecId3,Buy,1000,User6,CompanyD\n"
+                        "7000,ADD,OrdId7,SecId2,Buy,2000,User7,CompanyE\n"
+                        "8000,ADD,OrdId8,SecId2,Sell,5000,User8,CompanyE\n"
+                        "9000,MATCH,,SecId2,,,,\n"
+                        "10000,AMEND,OrdId8,,,4000,,\n"
+                        "11000,REDUCE,OrdId7,,,500,,\n"
+                        "12000,CANCEL,OrdId4,,,,,\n"
+                        "13000,CANCEL_USER,,,,,User5,\n"
+                        "14000,CANCEL_SECURITY,,SecId3,,1000,,\n"
+                        "15000,MATCH,,SecId2,,,,");
+
+    std::vector<std::string> csvEvents;
+    {
+        OrderFeedReader reader(csvPath);
+        ASSERT_EQ(reader.format(), OrderFeedReader::Format::CSV);
+        std::string binary;
+        appendBinaryFeedHeader(binary);
+        FeedEvent event;
+        while (reader.next(event)) {
+            csvEvents.push_back(std::to_string(event.timestampNs) + " " + std::string(feedEventTypeName(event.type)) +
+                                " " + std::string(event.orderId) + " " + std::string(event.securityId) + " " +
+                                std::string(event.side) + " " + std::to_string(event.qty) + " " +
+                                std::string(event.user) + " " + std::string(event.company));
+            appendBinaryFeedEvent(binary, event);
+        }
+        writeFileAtomically(binaryPath, binary);
+    }
+    ASSERT_EQ(csvEvents.size(), 15);
+    ASSERT_EQ(csvEvents[0], "1000 ADD OrdId1 SecId1 Buy 1000 User1 CompanyA");
+    ASSERT_EQ(csvEvents[14], "15000 MATCH  SecId2  0  ");
+
+    for (const auto& path : {csvPath, binaryPath}) {
+        OrderCache cache;
+        OrderFeedReader reader(path);
+        const auto report = replayFeed(cache, reader, ReplayOptions{});
+        ASSERT_EQ(report.events, 15);
+        ASSERT_EQ(report.latency[static_cast<size_t>(FeedEvent::Type::ADD)].count(), 8);
+        // 2700 before the writes; after them only CompanyE's 1500 buy remains, against sells of CompanyB and E
+        ASSERT_EQ(report.matchingSizeSum, 2700 + 1500);
+        ASSERT_EQ(cache.getAllOrders().size(), 5);
+    }
+
+    {
+        std::ostringstream out;
+        OrderCache cache;
+        OrderFeedReader reader(binaryPath);
+        ASSERT_EQ(reader.format(), OrderFeedReader::Format::BINARY);
+        replayFeed(cache, reader, ReplayOptions{true, 1000}).print(out);
+        ASSERT_NE(out.str().find("events: 15"), std::string::npos);
+    }
+
+    writeFileAtomically(csvPath, "1000,ADD,OrdId1,SecId1,Buy,1000,User1,CompanyA\n2000,ADD,OrdId2,SecId2\n");
+    OrderFeedReader reader(csvPath);
+    FeedEvent event;
+    ASSERT_TRUE(reader.next(event));
+    try {
+        reader.next(event);
+        FAIL() << "malformed line accepted";
+    } catch (const std::runtime_error& e) {
+        ASSERT_NE(std::string(e.what()).find(":2: expected 8 fields"), std::string::npos);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST(OrderCacheTest, PolicyInstantiationsAgree) {
+    OrderCache cache;
+    InstrumentedOrderCache instrumentedCache;
+    SingleThreadedOrderCache singleThreadedCache;
+    auto apply = [](auto& target) {
+        OrderGenerator generator(8, 6);
+        const auto orders = generator.generate(4000);
+        target.addOrders(orders);
+        for (size_t i = 0; i < orders.size(); i += 3) {
+            target.cancelOrder(orders[i].orderId());
+        }
+        for (size_t i = 1; i < orders.size(); i += 5) {
+            target.amendOrderQty(orders[i].orderId(), 50);
+        }
+        for (size_t i = 2; i < orders.size(); i += 7) {
+            target.reduceOrderQty(orders[i].orderId(), 5000);
+        }
+        target.cancelOrdersForUser(OrderGenerator::userName(1, 2));
+        target.cancelOrdersForSecIdWithMinimumQty(OrderGenerator::securityName(3), 4000);
+    };
+    apply(cache);
+    apply(instrumentedCache);
+    apply(singleThreadedCache);
+
+    ASSERT_EQ(describeOrders(instrumentedCache), describeOrders(cache));
+    ASSERT_EQ(describeOrders(singleThreadedCache), describeOrders(cache));
+    for (size_t security = 0; security < 8; security++) {
+        const auto securityId = OrderGenerator::securityName(security);
+        ASSERT_EQ(singleThreadedCache.getMatchingSizeForSecurity(securityId),
+                  cache.getMatchingSizeForSecurity(securityId));
+        ASSERT_EQ(instrumentedCache.getMatchingSizeForSecurity(securityId),
+                  cache.getMatchingSizeForSecurity(securityId));
+    }
+}
+
+// orders one line each, sorted, to compare caches that list them in different orders
+static std::vector<std::string> describeOrders(const std::vector<Order>& orders) {
+    std::vector<std::string> lines;
+    for (const auto& order : orders) {
+        lines.push_back(order.orderId() + " " + order.securityId() + " " + order.side() + " " +
+                        std::to_string(order.qty()) + " " + order.user() + " " + order.company());
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+static std::string sharedMemoryName(const std::string& test) {
+    return "/order_cache_" + test + "_" + std::to_string(::getpid());
+}
+
+TEST(SharedMemoryOrderCacheTest, MatchesOrderCache) {
+    // small enough that cancels regularly rebuild the order id index
+    const SharedMemoryCacheLimits limits{32, 64, 1024, 256};
+    SharedMemoryOrderCache sharedCache(sharedMemoryName("matches"), limits);
+    SharedMemoryOrderCacheReader reader(sharedCache.name());
+    OrderCache cache;
+
+    std::mt19937 rng(20);
+    const std::vector<std::string> securities = {"SecId0", "SecId1", "SecId2"};
+    for (int op = 0; op < 3000; op++) {
+        const auto orderId = "OrdId" + std::to_string(rng() % 24);
+        const auto& securityId = securities[rng() % securities.size()];
+        for (OrderCacheInterface* target : std::vector<OrderCacheInterface*>{&cache, &sharedCache}) {
+            std::mt19937 opRng(static_cast<unsigned int>(op));
+            switch (opRng() % 9) {
+                case 0:
+                    target->cancelOrder(orderId);
+                    break;
+                case 1:
+                    target->amendOrderQty(orderId, opRng() % 500);
+                    break;
+                case 2:
+                    target->reduceOrderQty(orderId, opRng() % 300);
+                    break;
+                case 3:
+                    target->cancelOrdersForSecIdWithMinimumQty(securityId, 300 + opRng() % 200);
+                    break;
+                case 4:
+                    target->cancelOrdersForUser("User" + std::to_string(opRng() % 4));
+                    break;
+                default:
+                    target->addOrder(Order{orderId, securityId, opRng() % 2 ? "Buy" : "Sell",
+                                           static_cast<unsigned int>(1 + opRng() % 500),
+                                           "User" + std::to_string(opRng() % 4),
+                                           "Company" + std::to_string(opRng() % 3)});
+            }
+        }
+
+        ASSERT_EQ(describeOrders(sharedCache.getAllOrders()), describeOrders(cache.getAllOrders())) << "op " << op;
+        ASSERT_EQ(describeOrders(reader.getAllOrders()), describeOrders(cache.getAllOrders())) << "op " << op;
+        for (const auto& id : securities) {
+            ASSERT_EQ(reader.getMatchingSizeForSecurity(id), cache.getMatchingSizeForSecurity(id)) << "op " << op;
+            ASSERT_EQ(sharedCache.getMatchingSizeForSecurity(id), cache.getMatchingSizeForSecurity(id));
+            for (const auto side : {OrderSide::BUY, OrderSide::SELL}) {
+                ASSERT_EQ(reader.getOpenQtyForUser("User1", id, side), cache.getOpenQtyForUser("User1", id, side));
+                ASSERT_EQ(reader.getOpenQtyForCompany("Company2", id, side),
+                          cache.getOpenQtyForCompany("Company2", id, side));
+            }
+        }
+    }
+    ASSERT_EQ(reader.getMatchingSizeForSecurity("SecId9"), 0);
+    ASSERT_EQ(reader.getOpenQtyForUser("User9", "SecId1", OrderSide::BUY), 0);
+}
+
+TEST(SharedMemoryOrderCacheTest, RejectsWritesThatDontFit) {
+    SharedMemoryOrderCache cache(sharedMemoryName("limits"), SharedMemoryCacheLimits{2, 8, 64, 8});
+    ASSERT_THROW(cache.addOrder(Order{std::string(25, 'x'), "SecId1", "Buy", 100, "User1", "CompanyA"}),
+                 std::invalid_argument);
+    ASSERT_THROW(cache.addOrder(Order{"OrdId1", "SecId1", "Bid", 100, "User1", "CompanyA"}), std::exception);
+
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 300, "User2", "CompanyB"});
+    ASSERT_THROW(cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User2", "CompanyB"}), std::length_error);
+    ASSERT_THROW(cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 100, std::string(64, 'u'), "CompanyA"}),
+                 std::length_error);
+    ASSERT_EQ(cache.getAllOrders().size(), 2);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 100);
+
+    // replacing a resting order needs no room, and a cancel frees its record
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 200, "User1", "CompanyA"});
+    cache.cancelOrder("OrdId2");
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User2", "CompanyB"});
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId1"), 200);
+
+    ASSERT_THROW(SharedMemoryOrderCacheReader(sharedMemoryName("missing")), std::runtime_error);
+}
+
+TEST(SharedMemoryOrderCacheTest, ReaderSeesWholeWrites) {
+    SharedMemoryOrderCache cache(sharedMemoryName("concurrent"), SharedMemoryCacheLimits{16384, 64, 1024, 256});
+    SharedMemoryOrderCacheReader reader(cache.name());
+    std::atomic<bool> done{false};
+    std::atomic<size_t> badReads{0};
+    std::thread readerThread([&] {
+        while (!done.load()) {
+            // orders come and go in crossing pairs of 100
+            if (reader.getMatchingSizeForSecurity("SecId1") % 100 != 0 || reader.getAllOrders().size() % 2 != 0) {
+                badReads++;
+            }
+        }
+    });
+
+    for (int i = 0; i < 20000; i++) {
+        const auto buyId = "Buy" + std::to_string(i);
+        const auto sellId = "Sell" + std::to_string(i);
+        cache.addOrders({Order{buyId, "SecId1", "Buy", 100, "User1", "CompanyA"},
+                         Order{sellId, "SecId1", "Sell", 100, "User2", "CompanyB"}});
+        if (i % 3 != 0) {
+            cache.cancelOrders({buyId, sellId});
+        }
+    }
+    done = true;
+    readerThread.join();
+    ASSERT_EQ(badReads, 0);
+    ASSERT_EQ(reader.getMatchingSizeForSecurity("SecId1"), 666700);
+}
+
+TEST(SharedMemoryOrderCacheTest, ReaderInAnotherProcess) {
+    SharedMemoryOrderCache cache(sharedMemoryName("process"), SharedMemoryCacheLimits{64, 64, 1024, 256});
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrder(Order{"OrdId2", "SecId1", "Sell", 600, "User2", "CompanyB"});
+
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        SharedMemoryOrderCacheReader reader(cache.name());
+        // waits for the parent's write below
+        while (reader.getAllOrders().size() < 3) {
+            std::this_thread::yield();
+        }
+        ::_exit(reader.getMatchingSizeForSecurity("SecId1") == 900 ? 0 : 1);
+    }
+    cache.addOrder(Order{"OrdId3", "SecId1", "Sell", 300, "User3", "CompanyC"});
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST(ShardedOrderCacheTest, MatchesSingleCache) {
+    OrderCache cache;
+    ShardedOrderCache shardedCache(4);
+    for (OrderCacheInterface* target : std::vector<OrderCacheInterface*>{&cache, &shardedCache}) {
+        target->addOrder(Order{"OrdId1", "SecId1", "Sell", 100, "User10", "Company2"});
+        target->addOrder(Order{"OrdId2", "SecId3", "Sell", 200, "User8", "Company2"});
+        target->addOrder(Order{"OrdId3", "SecId1", "Buy", 300, "User13", "Company2"});
+        target->addOrder(Order{"OrdId4", "SecId2", "Sell", 400, "User12", "Company2"});
+        target->addOrder(Order{"OrdId5", "SecId3", "Sell", 500, "User7", "Company2"});
+        target->addOrder(Order{"OrdId6", "SecId3", "Buy", 600, "User3", "Company1"});
+        target->addOrder(Order{"OrdId7", "SecId1", "Sell", 700, "User10", "Company2"});
+        target->addOrder(Order{"OrdId8", "SecId1", "Sell", 800, "User2", "Company1"});
+        target->addOrder(Order{"OrdId9", "SecId2", "Buy", 900, "User6", "Company2"});
+        target->addOrder(Order{"OrdId10", "SecId2", "Sell", 1000, "User5", "Company1"});
+        target->addOrder(Order{"OrdId11", "SecId1", "Sell", 1100, "User13", "Company2"});
+        target->addOrder(Order{"OrdId12", "SecId2", "Buy", 1200, "User9", "Company2"});
+        target->addOrder(Order{"OrdId13", "SecId1", "Sell", 1300, "User1", "Company"});
+        // moves OrdId2 to another security
+        target->addOrder(Order{"OrdId2", "SecId2", "Sell", 200, "User8", "Company1"});
+    }
+
+    for (const auto* securityId : {"SecId1", "SecId2", "SecId3"}) {
+        ASSERT_EQ(shardedCache.getMatchingSizeForSecurity(securityId), cache.getMatchingSizeForSecurity(securityId));
+    }
+    ASSERT_EQ(shardedCache.getAllOrders().size(), 13);
+    ASSERT_EQ(shardedCache.countOrdersForSecIdWithMinimumQty("SecId1", 800),
+              cache.countOrdersForSecIdWithMinimumQty("SecId1", 800));
+
+    cache.cancelOrdersForUser("User13");
+    shardedCache.cancelOrdersForUser("User13");
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 1000);
+    shardedCache.cancelOrdersForSecIdWithMinimumQty("SecId2", 1000);
+    cache.cancelOrder("OrdId6");
+    shardedCache.cancelOrder("OrdId6");
+
+    for (const auto* securityId : {"SecId1", "SecId2", "SecId3"}) {
+        ASSERT_EQ(shardedCache.getMatchingSizeForSecurity(securityId), cache.getMatchingSizeForSecurity(securityId));
+    }
+    ASSERT_EQ(shardedCache.getAllOrders().size(), cache.getAllOrders().size());
+    ASSERT_EQ(shardedCache.snapshot().size(), cache.snapshot().size());
+    ASSERT_EQ(shardedCache.snapshot({"", "", "Company2"}).size(), cache.snapshot({"", "", "Company2"}).size());
+}
+
+TEST(ShardedOrderCacheTest, BatchAddAndCancel) {
+    OrderCache cache;
+    ShardedOrderCache shardedCache(4);
+    for (OrderCacheInterface* target : std::vector<OrderCacheInterface*>{&cache, &shardedCache}) {
+        target->addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+        target->addOrders({Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"},
+                           Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"},
+                           Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"},
+                           Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"},
+                           Order{"OrdId1", "SecId3", "Buy", 1000, "User6", "CompanyD"},
+                           Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"},
+                           Order{"OrdId1", "SecId2", "Sell", 5000, "User8", "CompanyE"}});
+        ASSERT_EQ(target->getAllOrders().size(), 6);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId1"), 0);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId2"), 2700);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId3"), 0);
+
+        // an invalid side rejects the whole batch
+        ASSERT_ANY_THROW(target->addOrders({Order{"OrdId8", "SecId1", "Buy", 100, "User1", "CompanyA"},
+                                            Order{"OrdId9", "SecId1", "Hold", 100, "User1", "CompanyA"}}));
+        ASSERT_EQ(target->getAllOrders().size(), 6);
+
+        target->cancelOrders({"OrdId7", "OrdId1", "Unknown"});
+        ASSERT_EQ(target->getAllOrders().size(), 4);
+        ASSERT_EQ(target->getMatchingSizeForSecurity("SecId2"), 600);
+    }
+}
+
+TEST(ShardedOrderCacheTest, ConcurrentThroughput) {
+    constexpr size_t securityCount = 64;
+    constexpr size_t opsPerThread = 20000;
+    const size_t maxThreads = std::max(4u, std::thread::hardware_concurrency());
+
+    for (size_t threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        ShardedOrderCache cache;
+        for (size_t i = 0; i < securityCount; i++) {
+            const auto securityId = "SecId" + std::to_string(i);
+            cache.addOrder(Order{"Resting" + std::to_string(i), securityId, "Buy", 1000, "User0", "Company0"});
+            cache.addOrder(Order{"Resting" + std::to_string(i) + "S", securityId, "Sell", 400, "User1", "Company1"});
+        }
+
+        std::atomic<bool> mismatch = false;
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() {
+                for (size_t i = 0; i < opsPerThread; i++) {
+                    const auto securityId = "SecId" + std::to_string((t + i) % securityCount);
+                    if (i % 4 == 0) {
+                        const auto orderId = "T" + std::to_string(t) + "_" + std::to_string(i);
+                        cache.addOrder(Order{orderId, securityId, "Sell", 100, "User2", "Company2"});
+                        cache.cancelOrder(orderId);
+                    } else if (cache.getMatchingSizeForSecurity(securityId) < 400) {
+                        mismatch = true;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << "[ ShardedOrderCache ] threads=" << threadCount
+                  << " ops/sec=" << static_cast<uint64_t>(threadCount * opsPerThread / elapsed.count()) << std::endl;
+        ASSERT_FALSE(mismatch);
+        ASSERT_EQ(cache.getAllOrders().size(), 2 * securityCount);
+    }
+}
+
+TEST(PipelinedOrderCacheTest, ReadsOwnWrites) {
+    PipelinedOrderCache cache;
+    cache.addOrder(Order{"OrdId1", "SecId1", "Buy", 1000, "User1", "CompanyA"});
+    cache.addOrders({Order{"OrdId2", "SecId2", "Sell", 3000, "User2", "CompanyB"},
+                     Order{"OrdId3", "SecId1", "Sell", 500, "User3", "CompanyA"},
+                     Order{"OrdId4", "SecId2", "Buy", 600, "User4", "CompanyC"},
+                     Order{"OrdId5", "SecId2", "Buy", 100, "User5", "CompanyB"},
+                     Order{"OrdId6", "SecId3", "Buy", 1000, "User6", "CompanyD"},
+                     Order{"OrdId7", "SecId2", "Buy", 2000, "User7", "CompanyE"},
+                     Order{"OrdId8", "SecId2", "Sell", 5000, "User8", "CompanyE"}});
+    ASSERT_ANY_THROW(cache.addOrder(Order{"OrdId9", "SecId1", "Hold", 100, "User1", "CompanyA"}));
+
+    ASSERT_EQ(cache.getAllOrders().size(), 8);
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 2700);
+
+    cache.cancelOrder("OrdId7");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 700);
+    cache.cancelOrdersForUser("User8");
+    ASSERT_EQ(cache.getMatchingSizeForSecurity("SecId2"), 600);
+    cache.cancelOrdersForSecIdWithMinimumQty("SecId2", 3000);
+    ASSERT_EQ(cache.countOrdersForSecIdWithMinimumQty("SecId2", 0), 2);
+
+    cache.flush().wait();
+    ASSERT_EQ(cache.getPublishedMatchingSizeForSecurity("SecId2"), 0);
+    ASSERT_EQ(cache.publishedSnapshot().size(), 5);
+}
+
+TEST(PipelinedOrderCacheTest, ConcurrentProducers) {
+    constexpr size_t threadCount = 4;
+    constexpr size_t ordersPerThread = 5000;
+
+    PipelinedOrderCache cache(256);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threadCount; t++) {
+        producers.emplace_back([&, t]() {
+            for (size_t i = 0; i < ordersPerThread; i++) {
+                const auto orderId = "T" + std::to_string(t) + "_" + std::to_string(i);
+                cache.addOrder(Order{orderId, "SecId" + std::to_string(i % 8), i % 2 ? "Sell" : "Buy", 100,
+                                     "User" + std::to_string(t), "Company" + std::to_string(t)});
+                if (i % 2) {
+                    cache.cancelOrder(orderId);
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    ASSERT_EQ(cache.getAllOrders().size(), threadCount * ordersPerThread / 2);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
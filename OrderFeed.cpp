@@ -0,0 +1,224 @@
+#include "OrderFeed.h"
+
+#include <charconv>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr char BINARY_FEED_MAGIC[8] = "OCFEED1";
+
+constexpr std::array<std::string_view, FeedEvent::TYPE_COUNT> TYPE_NAMES = {
+    "ADD", "CANCEL", "CANCEL_USER", "CANCEL_SECURITY", "AMEND", "REDUCE", "MATCH",
+};
+
+// Binary record, unaligned and in native byte order: u64 timestamp_ns, u32 qty, u8 type, the u8 length of each
+// field, then the order id, security id, side, user and company
+constexpr size_t BINARY_FIELD_COUNT = 5;
+constexpr size_t BINARY_EVENT_HEADER_SIZE = 8 + 4 + 1 + BINARY_FIELD_COUNT;
+
+constexpr size_t CSV_FIELD_COUNT = 8;
+
+template <typename T>
+bool parseNumber(std::string_view field, T& value) {
+    if (field.empty()) {
+        value = 0;
+        return true;
+    }
+    const auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+    return error == std::errc() && end == field.data() + field.size();
+}
+
+}  // namespace
+
+std::string_view feedEventTypeName(FeedEvent::Type type) { return TYPE_NAMES[static_cast<size_t>(type)]; }
+
+void CsvTokenizer::loadBlock() {
+    m_mask = 0;
+    if (m_block >= m_end) {
+        return;
+    }
+    if (static_cast<size_t>(m_end - m_block) >= BLOCK_SIZE) {
+#ifdef __SSE2__
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_block));
+        const auto delimiters =
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(',')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+        m_mask = static_cast<uint32_t>(_mm_movemask_epi8(delimiters));
+        return;
+#endif
+    }
+    const auto size = std::min<size_t>(BLOCK_SIZE, static_cast<size_t>(m_end - m_block));
+    for (size_t i = 0; i < size; i++) {
+        m_mask |= uint32_t{m_block[i] == ',' || m_block[i] == '\n'} << i;
+    }
+}
+
+std::string_view CsvTokenizer::nextField(bool& endOfLine) {
+    while (m_mask == 0) {
+        m_block += BLOCK_SIZE;
+        if (m_block >= m_end) {
+            // last field of a file without a final newline
+            const std::string_view field(m_fieldStart, static_cast<size_t>(m_end - m_fieldStart));
+            m_fieldStart = m_end;
+            endOfLine = true;
+            return field;
+        }
+        loadBlock();
+    }
+
+    const char* delimiter = m_block + __builtin_ctz(m_mask);
+    m_mask &= m_mask - 1;
+    std::string_view field(m_fieldStart, static_cast<size_t>(delimiter - m_fieldStart));
+    m_fieldStart = delimiter + 1;
+    endOfLine = *delimiter == '\n';
+    if (endOfLine && !field.empty() && field.back() == '\r') {
+        field.remove_suffix(1);
+    }
+    return field;
+}
+
+void appendBinaryFeedHeader(std::string& buffer) { buffer.append(BINARY_FEED_MAGIC, sizeof(BINARY_FEED_MAGIC)); }
+
+void appendBinaryFeedEvent(std::string& buffer, const FeedEvent& event) {
+    const std::array<std::string_view, BINARY_FIELD_COUNT> fields = {event.orderId, event.securityId, event.side,
+                                                                     event.user, event.company};
+    char header[BINARY_EVENT_HEADER_SIZE];
+    std::memcpy(header, &event.timestampNs, 8);
+    std::memcpy(header + 8, &event.qty, 4);
+    header[12] = static_cast<char>(event.type);
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (fields[i].size() > UINT8_MAX) {
+            throw std::invalid_argument("feed field longer than 255 bytes: " + std::string(fields[i]));
+        }
+        header[13 + i] = static_cast<char>(fields[i].size());
+    }
+    buffer.append(header, sizeof(header));
+    for (const auto& field : fields) {
+        buffer.append(field);
+    }
+}
+
+namespace {
+
+OrderFeedReader::Format detectFormat(const MappedFile& file) {
+    return file.size() >= sizeof(BINARY_FEED_MAGIC) &&
+                   std::memcmp(file.data(), BINARY_FEED_MAGIC, sizeof(BINARY_FEED_MAGIC)) == 0
+               ? OrderFeedReader::Format::BINARY
+               : OrderFeedReader::Format::CSV;
+}
+
+}  // namespace
+
+OrderFeedReader::OrderFeedReader(const std::string& path)
+    : m_path(path),
+      m_file(path),
+      m_format(detectFormat(m_file)),
+      m_tokenizer(m_file.data(), m_format == Format::CSV ? m_file.size() : 0),
+      m_offset(m_format == Format::BINARY ? sizeof(BINARY_FEED_MAGIC) : 0) {}
+
+bool OrderFeedReader::next(FeedEvent& event) { return m_format == Format::CSV ? nextCsv(event) : nextBinary(event); }
+
+bool OrderFeedReader::nextCsv(FeedEvent& event) {
+    std::array<std::string_view, CSV_FIELD_COUNT> fields;
+    while (!m_tokenizer.atEnd()) {
+        m_line++;
+        size_t count = 0;
+        bool endOfLine = false;
+        while (!endOfLine) {
+            const auto field = m_tokenizer.nextField(endOfLine);
+            if (count < fields.size()) {
+                fields[count] = field;
+            }
+            count++;
+        }
+
+        if ((count == 1 && fields[0].empty()) || (!fields[0].empty() && fields[0].front() == '#') ||
+            fields[0] == "timestamp_ns") {
+            continue;
+        }
+        if (count != CSV_FIELD_COUNT) {
+            throwMalformed("expected " + std::to_string(CSV_FIELD_COUNT) + " fields, got " + std::to_string(count));
+        }
+
+        const auto typeIt = std::find(TYPE_NAMES.begin(), TYPE_NAMES.end(), fields[1]);
+        if (typeIt == TYPE_NAMES.end()) {
+            throwMalformed("unknown event type " + std::string(fields[1]));
+        }
+        if (!parseNumber(fields[0], event.timestampNs) || !parseNumber(fields[5], event.qty)) {
+            throwMalformed("bad number");
+        }
+        event.type = static_cast<FeedEvent::Type>(typeIt - TYPE_NAMES.begin());
+        event.orderId = fields[2];
+        event.securityId = fields[3];
+        event.side = fields[4];
+        event.user = fields[6];
+        event.company = fields[7];
+        return true;
+    }
+    return false;
+}
+
+bool OrderFeedReader::nextBinary(FeedEvent& event) {
+    if (m_offset == m_file.size()) {
+        return false;
+    }
+    m_line++;
+    if (m_file.size() - m_offset < BINARY_EVENT_HEADER_SIZE) {
+        throwMalformed("truncated event");
+    }
+    const char* record = m_file.data() + m_offset;
+    std::memcpy(&event.timestampNs, record, 8);
+    std::memcpy(&event.qty, record + 8, 4);
+    const auto type = static_cast<uint8_t>(record[12]);
+    if (type >= FeedEvent::TYPE_COUNT) {
+        throwMalformed("unknown event type " + std::to_string(type));
+    }
+    event.type = static_cast<FeedEvent::Type>(type);
+
+    size_t offset = m_offset + BINARY_EVENT_HEADER_SIZE;
+    std::array<std::string_view, BINARY_FIELD_COUNT> fields;
+    for (size_t i = 0; i < fields.size(); i++) {
+        const auto length = static_cast<uint8_t>(record[13 + i]);
+        if (m_file.size() - offset < length) {
+            throwMalformed("truncated event");
+        }
+        fields[i] = std::string_view(m_file.data() + offset, length);
+        offset += length;
+    }
+    m_offset = offset;
+
+    event.orderId = fields[0];
+    event.securityId = fields[1];
+    event.side = fields[2];
+    event.user = fields[3];
+    event.company = fields[4];
+    return true;
+}
+
+void OrderFeedReader::throwMalformed(const std::string& what) const {
+    throw std::runtime_error(m_path + (m_format == Format::CSV ? ":" : ": event ") + std::to_string(m_line) + ": " +
+                             what);
+}
+
+void ReplayReport::print(std::ostream& out) const {
+    const double seconds = static_cast<double>(elapsedNs) / 1e9;
+    out << "events: " << events << " in " << std::fixed << std::setprecision(3) << seconds << "s ("
+        << std::setprecision(0) << (seconds > 0 ? static_cast<double>(events) / seconds : 0) << " events/s)\n";
+    out.unsetf(std::ios::floatfield);
+    LatencyHistogram::printHeader(out, "event");
+    for (size_t type = 0; type < FeedEvent::TYPE_COUNT; type++) {
+        if (latency[type].count() > 0) {
+            latency[type].print(out, TYPE_NAMES[type]);
+        }
+    }
+    if (maxLagNs > 0) {
+        out << "max lag behind schedule: " << maxLagNs << "ns\n";
+    }
+    out << "matching size sum: " << matchingSizeSum << '\n';
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "OrderCache.h"
+#include "OrderCacheStats.h"
+#include "OrderJournal.h"
+
+// One event of a captured order feed. The views point into the mapped feed file; fields an event type doesn't use
+// are left empty.
+struct FeedEvent {
+    enum class Type : uint8_t {
+        ADD = 0,
+        CANCEL,
+        CANCEL_USER,
+        // cancels the orders of securityId with qty >= qty
+        CANCEL_SECURITY,
+        AMEND,
+        REDUCE,
+        // getMatchingSizeForSecurity(securityId)
+        MATCH,
+    };
+    static constexpr size_t TYPE_COUNT = static_cast<size_t>(Type::MATCH) + 1;
+
+    // capture time, only used to pace a replay
+    uint64_t timestampNs = 0;
+    Type type = Type::ADD;
+    std::string_view orderId;
+    std::string_view securityId;
+    std::string_view side;
+    // order qty for ADD, minimum qty for CANCEL_SECURITY, new qty for AMEND, filled qty for REDUCE
+    unsigned int qty = 0;
+    std::string_view user;
+    std::string_view company;
+};
+
+std::string_view feedEventTypeName(FeedEvent::Type type);
+
+// Splits CSV text into fields in place. Delimiters are located 16 bytes at a time (one SSE2 compare per block when
+// available), and every delimiter of a block is consumed from its bit mask before the next block is loaded.
+class CsvTokenizer {
+   public:
+    CsvTokenizer(const char* data, size_t size) : m_block(data), m_fieldStart(data), m_end(data + size) {
+        loadBlock();
+    }
+
+    bool atEnd() const { return m_fieldStart >= m_end; }
+
+    // Returns the next field, and whether it is the last one of its line. Quoting is not supported: feeds never
+    // contain commas inside fields.
+    std::string_view nextField(bool& endOfLine);
+
+   private:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    void loadBlock();
+
+    const char* m_block;
+    // delimiters of the current block after the last one consumed
+    uint32_t m_mask = 0;
+    const char* m_fieldStart;
+    const char* m_end;
+};
+
+// Compact binary feed: the magic, then one record per event with the fields back to back, each at most 255 bytes
+void appendBinaryFeedHeader(std::string& buffer);
+void appendBinaryFeedEvent(std::string& buffer, const FeedEvent& event);
+
+// Sequential reader over a memory-mapped feed file, CSV or binary (told apart by the binary magic). CSV lines are
+// "timestamp_ns,type,order_id,security_id,side,qty,user,company"; empty lines, lines starting with '#' and a header
+// line starting with "timestamp_ns" are skipped.
+class OrderFeedReader {
+   public:
+    enum class Format { CSV, BINARY };
+
+    explicit OrderFeedReader(const std::string& path);
+
+    // fills event with the next event, or returns false at the end of the feed; throws std::runtime_error on a
+    // malformed event
+    bool next(FeedEvent& event);
+
+    Format format() const { return m_format; }
+
+   private:
+    bool nextCsv(FeedEvent& event);
+    bool nextBinary(FeedEvent& event);
+    [[noreturn]] void throwMalformed(const std::string& what) const;
+
+    std::string m_path;
+    MappedFile m_file;
+    Format m_format;
+    CsvTokenizer m_tokenizer;
+    size_t m_offset = 0;
+    size_t m_line = 0;
+};
+
+struct ReplayOptions {
+    // replay at the recorded timestamps instead of as fast as possible
+    bool paced = false;
+    // time compression of a paced replay: 2 replays twice as fast as recorded
+    double speed = 1;
+};
+
+struct ReplayReport {
+    uint64_t events = 0;
+    uint64_t elapsedNs = 0;
+    // latency of the cache call of every event, by event type
+    std::array<LatencyHistogram, FeedEvent::TYPE_COUNT> latency;
+    // largest delay of an event behind its schedule, for a paced replay
+    uint64_t maxLagNs = 0;
+    // sum of the results of the MATCH events, to compare replays of the same feed
+    uint64_t matchingSizeSum = 0;
+
+    void print(std::ostream& out) const;
+};
+
+// Feeds every event of reader into cache, timing each cache call
+template <typename Cache>
+ReplayReport replayFeed(Cache& cache, OrderFeedReader& reader, const ReplayOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    // closer than this to an event's schedule, waiting spins instead of sleeping
+    constexpr auto SPIN_THRESHOLD = std::chrono::microseconds(200);
+
+    ReplayReport report;
+    FeedEvent event;
+    uint64_t firstTimestampNs = 0;
+    const auto start = Clock::now();
+    while (reader.next(event)) {
+        if (options.paced) {
+            if (report.events == 0) {
+                firstTimestampNs = event.timestampNs;
+            }
+            const auto offsetNs = event.timestampNs > firstTimestampNs ? event.timestampNs - firstTimestampNs : 0;
+            const auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(offsetNs / options.speed));
+            if (Clock::now() + SPIN_THRESHOLD < due) {
+                std::this_thread::sleep_until(due - SPIN_THRESHOLD);
+            }
+            auto now = Clock::now();
+            while (now < due) {
+                now = Clock::now();
+            }
+            report.maxLagNs = std::max(report.maxLagNs, CacheStats::elapsedNs(due, now));
+        }
+
+        const auto opStart = Clock::now();
+        switch (event.type) {
+            case FeedEvent::Type::ADD:
+                cache.addOrder(Order{std::string(event.orderId), std::string(event.securityId),
+                                     std::string(event.side), event.qty, std::string(event.user),
+                                     std::string(event.company)});
+                break;
+            case FeedEvent::Type::CANCEL:
+                cache.cancelOrder(event.orderId);
+                break;
+            case FeedEvent::Type::CANCEL_USER:
+                cache.cancelOrdersForUser(event.user);
+                break;
+            case FeedEvent::Type::CANCEL_SECURITY:
+                cache.cancelOrdersForSecIdWithMinimumQty(event.securityId, event.qty);
+                break;
+            case FeedEvent::Type::AMEND:
+                cache.amendOrderQty(event.orderId, event.qty);
+                break;
+            case FeedEvent::Type::REDUCE:
+                cache.reduceOrderQty(event.orderId, event.qty);
+                break;
+            case FeedEvent::Type::MATCH:
+                report.matchingSizeSum += cache.getMatchingSizeForSecurity(event.securityId);
+                break;
+        }
+        report.latency[static_cast<size_t>(event.type)].record(CacheStats::elapsedNs(opStart, Clock::now()));
+        report.events++;
+    }
+    report.elapsedNs = CacheStats::elapsedNs(start, Clock::now());
+    return report;
+}
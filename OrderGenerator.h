@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "OrderCache.h"
+
+// Deterministic synthetic order flow: the same parameters and seed always produce the same orders, so runs of the
+// benchmarks can be compared with each other. Every security is traded by companiesPerSecurity companies, each with
+// usersPerCompany users.
+class OrderGenerator {
+   public:
+    OrderGenerator(size_t securityCount, size_t companiesPerSecurity, uint64_t seed = 42, std::string idPrefix = "Ord",
+                   size_t usersPerCompany = 4)
+        : m_securityCount(securityCount),
+          m_companiesPerSecurity(companiesPerSecurity),
+          m_usersPerCompany(usersPerCompany),
+          m_idPrefix(std::move(idPrefix)),
+          m_rng(seed) {}
+
+    Order next() {
+        const auto security = m_rng() % m_securityCount;
+        const auto company = m_rng() % m_companiesPerSecurity;
+        const auto user = m_rng() % m_usersPerCompany;
+        const unsigned int qty = static_cast<unsigned int>(100 * (1 + m_rng() % 100));
+        return Order{m_idPrefix + std::to_string(m_nextId++), securityName(security), m_rng() % 2 ? "Sell" : "Buy",
+                     qty, userName(company, user), "Company" + std::to_string(company)};
+    }
+
+    std::vector<Order> generate(size_t count) {
+        std::vector<Order> orders;
+        orders.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            orders.push_back(next());
+        }
+        return orders;
+    }
+
+    static std::string securityName(size_t security) { return "SecId" + std::to_string(security); }
+    static std::string userName(size_t company, size_t user) {
+        return "User" + std::to_string(company) + "_" + std::to_string(user);
+    }
+
+   private:
+    size_t m_securityCount;
+    size_t m_companiesPerSecurity;
+    size_t m_usersPerCompany;
+    std::string m_idPrefix;
+    std::mt19937_64 m_rng;
+    uint64_t m_nextId = 0;
+};
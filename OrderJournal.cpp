@@ -0,0 +1,365 @@
+#include "OrderJournal.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr const char* SEGMENT_PREFIX = "journal-";
+constexpr const char* SEGMENT_SUFFIX = ".log";
+// payload length + checksum
+constexpr size_t FRAME_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+[[noreturn]] void throwSystemError(const std::string& what, const std::string& path) {
+    throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+void writeAll(int fd, const char* data, size_t size, const std::string& path) {
+    while (size > 0) {
+        const auto written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("cannot write", path);
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void syncDirectory(const std::string& directory) {
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throwSystemError("cannot open", directory);
+    }
+    ::fsync(fd);
+    ::close(fd);
+}
+
+template <typename T>
+void appendPod(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void appendString(std::string& buffer, std::string_view value) {
+    appendPod(buffer, static_cast<uint32_t>(value.size()));
+    buffer.append(value);
+}
+
+// Bounds-checked cursor over an entry payload
+struct PayloadReader {
+    const char* data;
+    size_t size;
+    bool ok = true;
+
+    template <typename T>
+    T read() {
+        T value{};
+        if (size < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        size -= sizeof(T);
+        return value;
+    }
+
+    std::string_view readString() {
+        const auto length = read<uint32_t>();
+        if (!ok || size < length) {
+            ok = false;
+            return {};
+        }
+        std::string_view value(data, length);
+        data += length;
+        size -= length;
+        return value;
+    }
+};
+
+std::string segmentPath(const std::string& directory, uint64_t firstSequence) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%020llu%s", SEGMENT_PREFIX, static_cast<unsigned long long>(firstSequence),
+                  SEGMENT_SUFFIX);
+    return directory + "/" + name;
+}
+
+// first sequences of the segments in directory, ascending
+std::vector<uint64_t> listSegments(const std::string& directory) {
+    DIR* dir = ::opendir(directory.c_str());
+    if (!dir) {
+        throwSystemError("cannot open", directory);
+    }
+
+    std::vector<uint64_t> segments;
+    const size_t prefixLength = std::strlen(SEGMENT_PREFIX);
+    const size_t suffixLength = std::strlen(SEGMENT_SUFFIX);
+    while (const dirent* entry = ::readdir(dir)) {
+        const std::string_view name(entry->d_name);
+        if (name.size() <= prefixLength + suffixLength || name.substr(0, prefixLength) != SEGMENT_PREFIX ||
+            name.substr(name.size() - suffixLength) != SEGMENT_SUFFIX) {
+            continue;
+        }
+        const auto digits = name.substr(prefixLength, name.size() - prefixLength - suffixLength);
+        if (!std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        segments.push_back(std::stoull(std::string(digits)));
+    }
+    ::closedir(dir);
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// Applies the entries of one segment from sequence onwards, advancing it, and stops at a torn or corrupt record or at a
+// gap in the sequence
+void replaySegment(const std::string& path, uint64_t& sequence,
+                   const std::function<void(const JournalEntry&)>& apply) {
+    const MappedFile file(path);
+    const char* data = file.data();
+    size_t remaining = file.size();
+
+    while (remaining > 0) {
+        if (remaining < FRAME_HEADER_SIZE) {
+            return;
+        }
+        uint32_t payloadLength, checksum;
+        std::memcpy(&payloadLength, data, sizeof(payloadLength));
+        std::memcpy(&checksum, data + sizeof(payloadLength), sizeof(checksum));
+        if (remaining - FRAME_HEADER_SIZE < payloadLength) {
+            return;
+        }
+        const std::string_view payload(data + FRAME_HEADER_SIZE, payloadLength);
+        if (journalChecksum(payload) != checksum) {
+            return;
+        }
+        data += FRAME_HEADER_SIZE + payloadLength;
+        remaining -= FRAME_HEADER_SIZE + payloadLength;
+
+        PayloadReader reader{payload.data(), payload.size()};
+        const auto entrySequence = reader.read<uint64_t>();
+        JournalEntry entry;
+        entry.type = static_cast<JournalEntry::Type>(reader.read<uint8_t>());
+        entry.side = static_cast<OrderSide>(reader.read<uint8_t>());
+        entry.qty = reader.read<uint32_t>();
+        entry.orderId = reader.readString();
+        entry.securityId = reader.readString();
+        entry.user = reader.readString();
+        entry.company = reader.readString();
+        if (!reader.ok) {
+            return;
+        }
+
+        if (entrySequence < sequence) {
+            continue;
+        }
+        if (entrySequence != sequence) {
+            return;
+        }
+        apply(entry);
+        sequence++;
+    }
+}
+
+}  // namespace
+
+uint32_t journalChecksum(std::string_view data) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+OrderJournal::OrderJournal(const std::string& directory, uint64_t firstSequence, size_t groupCommitSize)
+    : m_directory(directory), m_groupCommitSize(std::max<size_t>(groupCommitSize, 1)), m_nextSequence(firstSequence) {
+    const auto path = segmentPath(directory, firstSequence);
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        throwSystemError("cannot create", path);
+    }
+    syncDirectory(directory);
+}
+
+OrderJournal::~OrderJournal() {
+    try {
+        commit();
+    } catch (const std::exception&) {
+        // nothing left to report to; the entries were never acknowledged as durable
+    }
+    ::close(m_fd);
+}
+
+void OrderJournal::append(const JournalEntry& entry) {
+    const size_t frameStart = m_buffer.size();
+    m_buffer.append(FRAME_HEADER_SIZE, '\0');
+
+    appendPod(m_buffer, m_nextSequence++);
+    appendPod(m_buffer, static_cast<uint8_t>(entry.type));
+    appendPod(m_buffer, static_cast<uint8_t>(entry.side));
+    appendPod(m_buffer, static_cast<uint32_t>(entry.qty));
+    appendString(m_buffer, entry.orderId);
+    appendString(m_buffer, entry.securityId);
+    appendString(m_buffer, entry.user);
+    appendString(m_buffer, entry.company);
+
+    const std::string_view payload(m_buffer.data() + frameStart + FRAME_HEADER_SIZE,
+                                   m_buffer.size() - frameStart - FRAME_HEADER_SIZE);
+    const auto payloadLength = static_cast<uint32_t>(payload.size());
+    const auto checksum = journalChecksum(payload);
+    std::memcpy(&m_buffer[frameStart], &payloadLength, sizeof(payloadLength));
+    std::memcpy(&m_buffer[frameStart + sizeof(payloadLength)], &checksum, sizeof(checksum));
+
+    if (++m_pending >= m_groupCommitSize) {
+        try {
+            commit();
+        } catch (const std::exception&) {
+            // the caller won't apply the entry, so it must never reach the file
+            m_buffer.resize(frameStart);
+            m_nextSequence--;
+            m_pending--;
+            try {
+                truncateTornTail();
+            } catch (const std::exception&) {
+                // retried by the next commit
+            }
+            throw;
+        }
+    }
+}
+
+void OrderJournal::commit() {
+    if (m_buffer.empty()) {
+        return;
+    }
+    truncateTornTail();
+
+    // until the buffer is durable, part of it may have reached the file
+    m_tornTail = true;
+    writeAll(m_fd, m_buffer.data(), m_buffer.size(), m_directory);
+    if (::fdatasync(m_fd) != 0) {
+        throwSystemError("cannot sync journal in", m_directory);
+    }
+    m_tornTail = false;
+    m_committedSize += m_buffer.size();
+    m_buffer.clear();
+    m_pending = 0;
+}
+
+void OrderJournal::truncateTornTail() {
+    if (!m_tornTail) {
+        return;
+    }
+    const auto committedSize = static_cast<off_t>(m_committedSize);
+    if (::ftruncate(m_fd, committedSize) != 0 || ::lseek(m_fd, committedSize, SEEK_SET) != committedSize) {
+        throwSystemError("cannot truncate journal in", m_directory);
+    }
+    m_tornTail = false;
+}
+
+uint64_t OrderJournal::replay(const std::string& directory, uint64_t fromSequence,
+                              const std::function<void(const JournalEntry&)>& apply) {
+    const auto segments = listSegments(directory);
+
+    uint64_t sequence = fromSequence;
+    for (size_t i = 0; i < segments.size(); i++) {
+        // skip segments wholly before fromSequence, and stop at a gap between segments
+        if (i + 1 < segments.size() && segments[i + 1] <= sequence) {
+            continue;
+        }
+        if (segments[i] > sequence) {
+            break;
+        }
+        // a torn tail ends its segment only: a checkpoint taken after it starts the next segment where it stopped
+        replaySegment(segmentPath(directory, segments[i]), sequence, apply);
+    }
+    return sequence;
+}
+
+uint64_t OrderJournal::endSequence(const std::string& directory) {
+    const auto segments = listSegments(directory);
+    if (segments.empty()) {
+        return 0;
+    }
+    uint64_t sequence = segments.back();
+    replaySegment(segmentPath(directory, segments.back()), sequence, [](const JournalEntry&) {});
+    return sequence;
+}
+
+void OrderJournal::removeSegmentsBefore(const std::string& directory, uint64_t sequence) {
+    const auto segments = listSegments(directory);
+    for (size_t i = 0; i + 1 < segments.size() && segments[i + 1] <= sequence; i++) {
+        const auto path = segmentPath(directory, segments[i]);
+        if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+            throwSystemError("cannot remove", path);
+        }
+    }
+}
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throwSystemError("cannot open", path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throwSystemError("cannot stat", path);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    // an empty file cannot be mapped, and has nothing to read anyway
+    if (m_size > 0) {
+        void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            throwSystemError("cannot map", path);
+        }
+        m_data = static_cast<const char*>(data);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (m_data) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+void writeFileAtomically(const std::string& path, std::string_view data) {
+    const auto tmpPath = path + ".tmp";
+    const int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throwSystemError("cannot create", tmpPath);
+    }
+    try {
+        writeAll(fd, data.data(), data.size(), tmpPath);
+        if (::fsync(fd) != 0) {
+            throwSystemError("cannot sync", tmpPath);
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throwSystemError("cannot rename", tmpPath);
+    }
+    const auto slash = path.find_last_of('/');
+    syncDirectory(slash == std::string::npos ? "." : path.substr(0, slash));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "OrderView.h"
+
+// One write applied to the cache. Views point into the caller's order or into the mapped journal segment; unused
+// fields are left empty.
+struct JournalEntry {
+    enum class Type : uint8_t { ADD = 1, CANCEL, CANCEL_USER, CANCEL_SEC_ID_MIN_QTY, AMEND_QTY };
+
+    Type type = Type::ADD;
+    std::string_view orderId = {};
+    std::string_view securityId = {};
+    std::string_view user = {};
+    std::string_view company = {};
+    OrderSide side = OrderSide::BUY;
+    // order qty for ADD, minimum qty for CANCEL_SEC_ID_MIN_QTY, new qty for AMEND_QTY
+    unsigned int qty = 0;
+};
+
+// Append-only binary write-ahead journal. Each entry is framed with its length, a checksum and a sequence number, so
+// replay stops cleanly at a torn tail and skips entries already covered by a snapshot. Entries are buffered and
+// written with a single write + fdatasync once groupCommitSize of them are pending (group commit), or on commit().
+//
+// The journal lives in a directory of segments named after the sequence of their first entry; a checkpoint starts a
+// new segment, and segments entirely before the latest snapshot are removed.
+class OrderJournal {
+   public:
+    static constexpr size_t DEFAULT_GROUP_COMMIT_SIZE = 64;
+
+    // starts a new segment in directory whose first entry gets firstSequence
+    OrderJournal(const std::string& directory, uint64_t firstSequence, size_t groupCommitSize);
+    ~OrderJournal();
+
+    OrderJournal(const OrderJournal&) = delete;
+    OrderJournal& operator=(const OrderJournal&) = delete;
+
+    // If the group commit it triggers fails, the entry is dropped and the error rethrown: it is never written later
+    void append(const JournalEntry& entry);
+    // Makes every appended entry durable. On failure the entries stay buffered, and whatever part of them reached the
+    // file is truncated away before the next attempt, so the segment never holds a torn or duplicated frame.
+    void commit();
+
+    uint64_t nextSequence() const { return m_nextSequence; }
+
+    // Applies, in order, every valid entry of the segments in directory with a sequence >= fromSequence. Returns the
+    // sequence following the last valid entry, or fromSequence if there is none.
+    static uint64_t replay(const std::string& directory, uint64_t fromSequence,
+                           const std::function<void(const JournalEntry&)>& apply);
+
+    // sequence following the last valid entry of the newest segment, or 0 for an empty directory
+    static uint64_t endSequence(const std::string& directory);
+
+    // removes the segments whose entries all precede sequence
+    static void removeSegmentsBefore(const std::string& directory, uint64_t sequence);
+
+   private:
+    // cuts the segment back to its committed size after a failed commit
+    void truncateTornTail();
+
+    std::string m_directory;
+    int m_fd = -1;
+    // size of the segment up to the last commit, and whether a failed commit may have written past it
+    uint64_t m_committedSize = 0;
+    bool m_tornTail = false;
+    std::string m_buffer;
+    size_t m_pending = 0;
+    size_t m_groupCommitSize;
+    uint64_t m_nextSequence;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+   private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// writes data to path through a temporary file and a rename, so readers see either the old or the new file
+void writeFileAtomically(const std::string& path, std::string_view data);
+
+uint32_t journalChecksum(std::string_view data);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using OrderHandle = uint32_t;
+
+// Slab allocator for resting orders. Records live in fixed-size slabs, so a handle (and the address behind it) stays
+// valid until the order is released, and released slots are recycled before the pool grows. Order id strings are
+// pooled next to the records and keep their capacity when a slot is reused.
+template <typename Record>
+class OrderPool {
+   public:
+    static constexpr size_t SLAB_SIZE = 4096;
+
+    OrderHandle allocate(std::string_view orderId, const Record& record) {
+        OrderHandle handle;
+        if (!m_freeHandles.empty()) {
+            handle = m_freeHandles.back();
+            m_freeHandles.pop_back();
+        } else {
+            if (m_nextHandle == capacity()) {
+                m_slabs.push_back(std::make_unique<Slab>());
+            }
+            handle = m_nextHandle++;
+        }
+
+        auto& slab = *m_slabs[handle / SLAB_SIZE];
+        slab.records[handle % SLAB_SIZE] = record;
+        slab.orderIds[handle % SLAB_SIZE].assign(orderId.data(), orderId.size());
+        m_size++;
+        return handle;
+    }
+
+    // makes room for count live orders without growing in between
+    void reserve(size_t count) {
+        while (capacity() < count) {
+            m_slabs.push_back(std::make_unique<Slab>());
+        }
+    }
+
+    void release(OrderHandle handle) {
+        m_freeHandles.push_back(handle);
+        m_size--;
+    }
+
+    Record& operator[](OrderHandle handle) { return m_slabs[handle / SLAB_SIZE]->records[handle % SLAB_SIZE]; }
+    const Record& operator[](OrderHandle handle) const {
+        return m_slabs[handle / SLAB_SIZE]->records[handle % SLAB_SIZE];
+    }
+
+    // the view stays valid until the handle is released
+    std::string_view orderId(OrderHandle handle) const {
+        return m_slabs[handle / SLAB_SIZE]->orderIds[handle % SLAB_SIZE];
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_slabs.size() * SLAB_SIZE; }
+
+   private:
+    struct Slab {
+        std::array<Record, SLAB_SIZE> records;
+        std::array<std::string, SLAB_SIZE> orderIds;
+    };
+
+    std::vector<std::unique_ptr<Slab>> m_slabs;
+    std::vector<OrderHandle> m_freeHandles;
+    OrderHandle m_nextHandle = 0;
+    size_t m_size = 0;
+};
@@ -0,0 +1,106 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "OrderCache.h"
+#include "OrderFeed.h"
+#include "PipelinedOrderCache.h"
+#include "ShardedOrderCache.h"
+#include "SharedMemoryOrderCache.h"
+
+namespace {
+
+void usage() {
+    std::cerr << "usage: order_replay [--cache plain|single|instrumented|sharded|pipelined|shared] [--paced]\n"
+                 "                    [--speed X] [--convert OUTPUT] FEED\n"
+                 "Replays a CSV or binary order feed into a cache and reports throughput and per-event latency.\n"
+                 "  --paced           replay at the recorded timestamps instead of as fast as possible\n"
+                 "  --speed X         with --paced, replay X times faster than recorded\n"
+                 "  --convert OUTPUT  write FEED to OUTPUT in the binary feed format instead of replaying it\n";
+}
+
+void convert(const std::string& feedPath, const std::string& outputPath) {
+    OrderFeedReader reader(feedPath);
+    std::string buffer;
+    appendBinaryFeedHeader(buffer);
+    FeedEvent event;
+    while (reader.next(event)) {
+        appendBinaryFeedEvent(buffer, event);
+    }
+    writeFileAtomically(outputPath, buffer);
+}
+
+template <typename Cache>
+void replay(Cache& cache, const std::string& feedPath, const ReplayOptions& options) {
+    OrderFeedReader reader(feedPath);
+    replayFeed(cache, reader, options).print(std::cout);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string cacheKind = "plain";
+    std::string convertPath;
+    std::string feedPath;
+    ReplayOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--paced") {
+            options.paced = true;
+        } else if ((arg == "--cache" || arg == "--speed" || arg == "--convert") && i + 1 < argc) {
+            const std::string value = argv[++i];
+            if (arg == "--cache") {
+                cacheKind = value;
+            } else if (arg == "--speed") {
+                options.speed = std::atof(value.c_str());
+            } else {
+                convertPath = value;
+            }
+        } else if (feedPath.empty() && !arg.empty() && arg[0] != '-') {
+            feedPath = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (feedPath.empty() || options.speed <= 0) {
+        usage();
+        return 2;
+    }
+
+    try {
+        if (!convertPath.empty()) {
+            convert(feedPath, convertPath);
+        } else if (cacheKind == "plain") {
+            OrderCache cache;
+            replay(cache, feedPath, options);
+        } else if (cacheKind == "single") {
+            SingleThreadedOrderCache cache;
+            replay(cache, feedPath, options);
+        } else if (cacheKind == "instrumented") {
+            InstrumentedOrderCache cache;
+            replay(cache, feedPath, options);
+            cache.stats().print(std::cout);
+        } else if (cacheKind == "sharded") {
+            ShardedOrderCache cache;
+            replay(cache, feedPath, options);
+        } else if (cacheKind == "pipelined") {
+            // times the enqueue of each write; reads wait for the writes queued before them
+            PipelinedOrderCache cache;
+            replay(cache, feedPath, options);
+        } else if (cacheKind == "shared") {
+            SharedMemoryOrderCache cache("/order_replay_" + std::to_string(::getpid()));
+            replay(cache, feedPath, options);
+        } else {
+            usage();
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "order_replay: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class OrderSide : uint8_t { BUY = 0, SELL };
+constexpr const size_t SIDE_SIZE = 2;
+
+// Non-owning view of a resting order
+struct OrderView {
+    std::string_view orderId;
+    std::string_view securityId;
+    OrderSide side;
+    unsigned int qty;
+    std::string_view user;
+    std::string_view company;
+};
+
+// Matching size of one security; the id is viewed in the symbol table of the cache it came from
+struct SecurityMatchingSize {
+    std::string_view securityId;
+    unsigned int matchingSize;
+};
+
+// Restricts an iteration to the orders matching every non-empty field
+struct OrderFilter {
+    std::string_view securityId;
+    std::string_view user;
+    std::string_view company;
+
+    bool matches(const OrderView& order) const {
+        return (securityId.empty() || securityId == order.securityId) && (user.empty() || user == order.user) &&
+               (company.empty() || company == order.company);
+    }
+};
+
+using OrderVisitor = std::function<void(const OrderView&)>;
+
+// Point-in-time copy of resting orders: one fixed-size entry per order plus a single buffer holding every order id, so
+// taking it costs no allocation per order. Users, companies and security ids are viewed in the symbol tables of the
+// cache it was taken from, so a snapshot must not outlive that cache.
+class OrderSnapshot {
+   public:
+    void reserve(size_t orderCount) {
+        m_entries.reserve(orderCount);
+        m_orderIds.reserve(orderCount * 16);
+    }
+
+    void add(const OrderView& order) {
+        m_entries.push_back(Entry{order.securityId, order.user, order.company, static_cast<uint32_t>(m_orderIds.size()),
+                                  static_cast<uint32_t>(order.orderId.size()), order.qty, order.side});
+        m_orderIds.append(order.orderId);
+    }
+
+    void append(const OrderSnapshot& other) {
+        m_entries.reserve(m_entries.size() + other.m_entries.size());
+        for (auto entry : other.m_entries) {
+            entry.orderIdOffset += static_cast<uint32_t>(m_orderIds.size());
+            m_entries.push_back(entry);
+        }
+        m_orderIds.append(other.m_orderIds);
+    }
+
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+    OrderView operator[](size_t i) const {
+        const auto& entry = m_entries[i];
+        return OrderView{std::string_view(m_orderIds).substr(entry.orderIdOffset, entry.orderIdLength),
+                         entry.securityId,
+                         entry.side,
+                         entry.qty,
+                         entry.user,
+                         entry.company};
+    }
+
+    void forEach(const OrderVisitor& visitor, const OrderFilter& filter = {}) const {
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            const auto order = (*this)[i];
+            if (filter.matches(order)) {
+                visitor(order);
+            }
+        }
+    }
+
+   private:
+    struct Entry {
+        std::string_view securityId;
+        std::string_view user;
+        std::string_view company;
+        uint32_t orderIdOffset;
+        uint32_t orderIdLength;
+        unsigned int qty;
+        OrderSide side;
+    };
+
+    std::vector<Entry> m_entries;
+    std::string m_orderIds;
+};
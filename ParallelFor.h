@@ -0,0 +1,26 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Splits [0, count) into contiguous ranges of at least minChunk items and calls f(begin, end) for each of them in
+// parallel, on up to threadCount threads (0 means one per core). The calling thread takes the first range.
+template <typename F>
+void parallelFor(size_t count, size_t minChunk, size_t threadCount, F&& f) {
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    const size_t chunks = std::max<size_t>(std::min(threadCount, count / std::max<size_t>(minChunk, 1)), 1);
+
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        workers.emplace_back([&f, chunk, chunks, count]() { f(chunk * count / chunks, (chunk + 1) * count / chunks); });
+    }
+    f(0, count / chunks);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
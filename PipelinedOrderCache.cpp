@@ -0,0 +1,189 @@
+#include "PipelinedOrderCache.h"
+
+#include <chrono>
+
+PipelinedOrderCache::PipelinedOrderCache(size_t queueCapacity)
+    : m_queue(queueCapacity), m_applyThread(&PipelinedOrderCache::applyLoop, this) {}
+
+PipelinedOrderCache::~PipelinedOrderCache() {
+    m_stopping.store(true, std::memory_order_release);
+    m_applyThread.join();
+}
+
+void PipelinedOrderCache::push(Command&& command) const {
+    for (size_t attempt = 0; !m_queue.tryPush(std::move(command)); attempt++) {
+        if (attempt > 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void PipelinedOrderCache::addOrder(Order order) {
+    // rejected orders throw to the producer instead of on the apply thread
+    OrderCache::toOrderSide(order.side());
+    push(std::move(order));
+}
+
+void PipelinedOrderCache::addOrders(std::vector<Order> orders) {
+    for (const auto& order : orders) {
+        OrderCache::toOrderSide(order.side());
+    }
+    for (auto& order : orders) {
+        push(std::move(order));
+    }
+}
+
+void PipelinedOrderCache::cancelOrder(std::string_view orderId) { push(CancelCommand{std::string(orderId)}); }
+
+void PipelinedOrderCache::cancelOrders(const std::vector<std::string_view>& orderIds) {
+    for (const auto& orderId : orderIds) {
+        push(CancelCommand{std::string(orderId)});
+    }
+}
+
+void PipelinedOrderCache::amendOrderQty(std::string_view orderId, unsigned int newQty) {
+    push(AmendQtyCommand{std::string(orderId), newQty});
+}
+
+void PipelinedOrderCache::reduceOrderQty(std::string_view orderId, unsigned int delta) {
+    push(ReduceQtyCommand{std::string(orderId), delta});
+}
+
+void PipelinedOrderCache::cancelOrdersForUser(std::string_view user) { push(CancelUserCommand{std::string(user)}); }
+
+void PipelinedOrderCache::cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) {
+    push(CancelSecIdCommand{std::string(securityId), minQty});
+}
+
+std::future<void> PipelinedOrderCache::flush() const {
+    FlushCommand command;
+    auto applied = command.applied.get_future();
+    push(std::move(command));
+    return applied;
+}
+
+unsigned int PipelinedOrderCache::getMatchingSizeForSecurity(std::string_view securityId) {
+    flush().wait();
+    return m_cache.getMatchingSizeForSecurity(securityId);
+}
+
+std::vector<SecurityMatchingSize> PipelinedOrderCache::getMatchingSizesForAllSecurities(size_t threadCount) const {
+    flush().wait();
+    return m_cache.getMatchingSizesForAllSecurities(threadCount);
+}
+
+uint64_t PipelinedOrderCache::getOpenQtyForUser(std::string_view user, std::string_view securityId,
+                                                OrderSide side) const {
+    return m_cache.getOpenQtyForUser(user, securityId, side);
+}
+
+uint64_t PipelinedOrderCache::getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                                   OrderSide side) const {
+    return m_cache.getOpenQtyForCompany(company, securityId, side);
+}
+
+std::vector<Order> PipelinedOrderCache::getAllOrders() const {
+    flush().wait();
+    return m_cache.getAllOrders();
+}
+
+std::vector<Order> PipelinedOrderCache::getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                                        unsigned int minQty) const {
+    flush().wait();
+    return m_cache.getOrdersForSecIdWithMinimumQty(securityId, minQty);
+}
+
+size_t PipelinedOrderCache::countOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                              unsigned int minQty) const {
+    flush().wait();
+    return m_cache.countOrdersForSecIdWithMinimumQty(securityId, minQty);
+}
+
+unsigned int PipelinedOrderCache::getPublishedMatchingSizeForSecurity(std::string_view securityId) {
+    return m_cache.getMatchingSizeForSecurity(securityId);
+}
+
+OrderSnapshot PipelinedOrderCache::publishedSnapshot(const OrderFilter& filter) const {
+    return m_cache.snapshot(filter);
+}
+
+void PipelinedOrderCache::applyLoop() {
+    std::vector<Command> batch;
+    batch.reserve(MAX_APPLY_BATCH);
+
+    size_t idleRounds = 0;
+    while (true) {
+        Command command;
+        while (batch.size() < MAX_APPLY_BATCH && m_queue.tryPop(command)) {
+            batch.push_back(std::move(command));
+        }
+
+        if (!batch.empty()) {
+            applyBatch(batch);
+            batch.clear();
+            idleRounds = 0;
+            continue;
+        }
+
+        // producers are done once stopping is set, so an empty queue then means everything was applied
+        if (m_stopping.load(std::memory_order_acquire)) {
+            if (!m_queue.tryPop(command)) {
+                return;
+            }
+            batch.push_back(std::move(command));
+            continue;
+        }
+
+        // back off from spinning to yielding to sleeping while the queue stays empty
+        idleRounds++;
+        if (idleRounds > 1024) {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        } else if (idleRounds > 64) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void PipelinedOrderCache::applyBatch(std::vector<Command>& batch) {
+    // runs of adds and of cancels go to the cache as one batch, under one lock acquisition
+    std::vector<Order> orders;
+    std::vector<std::string_view> orderIds;
+    auto applyPending = [&]() {
+        if (!orders.empty()) {
+            m_cache.addOrders(std::move(orders));
+            orders.clear();
+        }
+        if (!orderIds.empty()) {
+            m_cache.cancelOrders(orderIds);
+            orderIds.clear();
+        }
+    };
+
+    for (auto& command : batch) {
+        if (auto* order = std::get_if<Order>(&command)) {
+            if (!orderIds.empty()) {
+                applyPending();
+            }
+            orders.push_back(std::move(*order));
+        } else if (auto* cancel = std::get_if<CancelCommand>(&command)) {
+            if (!orders.empty()) {
+                applyPending();
+            }
+            orderIds.emplace_back(cancel->orderId);
+        } else {
+            applyPending();
+            if (auto* amend = std::get_if<AmendQtyCommand>(&command)) {
+                m_cache.amendOrderQty(amend->orderId, amend->newQty);
+            } else if (auto* reduce = std::get_if<ReduceQtyCommand>(&command)) {
+                m_cache.reduceOrderQty(reduce->orderId, reduce->delta);
+            } else if (auto* cancelUser = std::get_if<CancelUserCommand>(&command)) {
+                m_cache.cancelOrdersForUser(cancelUser->user);
+            } else if (auto* cancelSecId = std::get_if<CancelSecIdCommand>(&command)) {
+                m_cache.cancelOrdersForSecIdWithMinimumQty(cancelSecId->securityId, cancelSecId->minQty);
+            } else if (auto* flush = std::get_if<FlushCommand>(&command)) {
+                flush->applied.set_value();
+            }
+        }
+    }
+    applyPending();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "MpscQueue.h"
+#include "OrderCache.h"
+
+// Pipelined OrderCache: producers validate their writes and push them into a lock-free MPSC ring buffer, and a single
+// apply thread drains it in batches into an OrderCache it alone writes to. Producers never contend on the cache
+// lock, only on the queue's enqueue position.
+//
+// Reads through OrderCacheInterface wait until every command queued before them has been applied, so a thread always
+// reads its own writes. The published reads and the open qty queries skip that wait and see the state as of the last
+// applied batch.
+class PipelinedOrderCache : public OrderCacheInterface {
+   public:
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 1 << 14;
+    static constexpr size_t MAX_APPLY_BATCH = 1024;
+
+    explicit PipelinedOrderCache(size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+    // applies everything still queued before returning
+    ~PipelinedOrderCache() override;
+
+    void addOrder(Order order) override;
+    void addOrders(std::vector<Order> orders) override;
+
+    void cancelOrder(std::string_view orderId) override;
+    void cancelOrders(const std::vector<std::string_view>& orderIds) override;
+
+    void cancelOrdersForUser(std::string_view user) override;
+
+    void amendOrderQty(std::string_view orderId, unsigned int newQty) override;
+    void reduceOrderQty(std::string_view orderId, unsigned int delta) override;
+
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) override;
+
+    unsigned int getMatchingSizeForSecurity(std::string_view securityId) override;
+    std::vector<SecurityMatchingSize> getMatchingSizesForAllSecurities(size_t threadCount = 0) const;
+
+    // Read straight from the cache's lock-free counters, without waiting for the queue: they see the state as of the
+    // last applied command, so flush() first to read your own writes.
+    uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const override;
+    uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                  OrderSide side) const override;
+
+    std::vector<Order> getAllOrders() const override;
+
+    std::vector<Order> getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                       unsigned int minQty) const override;
+    size_t countOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) const override;
+
+    // becomes ready once every command queued before it has been applied
+    std::future<void> flush() const;
+
+    unsigned int getPublishedMatchingSizeForSecurity(std::string_view securityId);
+    OrderSnapshot publishedSnapshot(const OrderFilter& filter = {}) const;
+
+   private:
+    struct CancelCommand {
+        std::string orderId;
+    };
+    struct AmendQtyCommand {
+        std::string orderId;
+        unsigned int newQty;
+    };
+    struct ReduceQtyCommand {
+        std::string orderId;
+        unsigned int delta;
+    };
+    struct CancelUserCommand {
+        std::string user;
+    };
+    struct CancelSecIdCommand {
+        std::string securityId;
+        unsigned int minQty;
+    };
+    struct FlushCommand {
+        std::promise<void> applied;
+    };
+    using Command = std::variant<std::monostate, Order, CancelCommand, AmendQtyCommand, ReduceQtyCommand,
+                                 CancelUserCommand, CancelSecIdCommand, FlushCommand>;
+
+    // spins, then yields, while the queue is full
+    void push(Command&& command) const;
+    void applyLoop();
+    void applyBatch(std::vector<Command>& batch);
+
+    OrderCache m_cache;
+    mutable MpscQueue<Command> m_queue;
+    std::atomic<bool> m_stopping{false};
+    std::thread m_applyThread;
+};
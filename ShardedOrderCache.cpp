@@ -0,0 +1,300 @@
+#include "ShardedOrderCache.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+#include "ParallelFor.h"
+
+ShardedOrderCache::ShardedOrderCache(size_t shardCount)
+    : m_cacheShards(std::max<size_t>(shardCount, 1)), m_routeShards(std::max<size_t>(shardCount, 1)) {}
+
+size_t ShardedOrderCache::cacheShardFor(std::string_view securityId) const {
+    return std::hash<std::string_view>{}(securityId) % m_cacheShards.size();
+}
+
+size_t ShardedOrderCache::routeShardIndexFor(std::string_view orderId) const {
+    return std::hash<std::string_view>{}(orderId) % m_routeShards.size();
+}
+
+ShardedOrderCache::RouteShard& ShardedOrderCache::routeShardFor(std::string_view orderId) {
+    return m_routeShards[routeShardIndexFor(orderId)];
+}
+
+ShardedOrderCache::RouteLocks ShardedOrderCache::lockAllRouteShards() {
+    RouteLocks lcks;
+    lcks.reserve(m_routeShards.size());
+    for (auto& routeShard : m_routeShards) {
+        lcks.emplace_back(routeShard.mtx);
+    }
+    return lcks;
+}
+
+std::vector<std::shared_lock<std::shared_mutex>> ShardedOrderCache::lockAllRouteShardsShared() const {
+    std::vector<std::shared_lock<std::shared_mutex>> lcks;
+    lcks.reserve(m_routeShards.size());
+    for (const auto& routeShard : m_routeShards) {
+        lcks.emplace_back(routeShard.mtx);
+    }
+    return lcks;
+}
+
+ShardedOrderCache::RouteLocks ShardedOrderCache::lockRouteShardsFor(const std::vector<std::string_view>& orderIds) {
+    std::vector<bool> touched(m_routeShards.size());
+    for (const auto& orderId : orderIds) {
+        touched[routeShardIndexFor(orderId)] = true;
+    }
+
+    RouteLocks lcks;
+    for (size_t i = 0; i < m_routeShards.size(); i++) {
+        if (touched[i]) {
+            lcks.emplace_back(m_routeShards[i].mtx);
+        }
+    }
+    return lcks;
+}
+
+void ShardedOrderCache::eraseRoutes(const std::vector<std::string>& orderIds) {
+    for (const auto& orderId : orderIds) {
+        routeShardFor(orderId).cacheShardByOrderId.erase(orderId);
+    }
+}
+
+void ShardedOrderCache::addOrder(Order order) {
+    const auto orderId = order.orderId();
+    const auto cacheShard = cacheShardFor(order.securityId());
+    auto& routeShard = routeShardFor(orderId);
+
+    std::lock_guard<std::shared_mutex> lck(routeShard.mtx);
+
+    // add first: if the order is rejected the cache is left untouched
+    m_cacheShards[cacheShard].addOrder(std::move(order));
+
+    auto [routeIt, inserted] = routeShard.tryAddRoute(orderId, cacheShard);
+    if (!inserted && routeIt->second.cacheShard != cacheShard) {
+        // a reused order id replaces the resting order, which lives on another shard
+        m_cacheShards[routeIt->second.cacheShard].cancelOrder(orderId);
+        routeIt->second.cacheShard = cacheShard;
+    }
+}
+
+void ShardedOrderCache::addOrders(std::vector<Order> orders) {
+    // validate up front so a bad order leaves every shard untouched
+    for (const auto& order : orders) {
+        OrderCache::toOrderSide(order.side());
+    }
+
+    // an order id repeated in the batch only keeps its last order, which is what applying them in turn would leave
+    std::unordered_map<std::string_view, size_t> lastIndexByOrderId;
+    lastIndexByOrderId.reserve(orders.size());
+    std::vector<std::string_view> orderIds;
+    orderIds.reserve(orders.size());
+    for (size_t i = 0; i < orders.size(); i++) {
+        lastIndexByOrderId[orders[i].orderId()] = i;
+        orderIds.emplace_back(orders[i].orderId());
+    }
+
+    const auto lcks = lockRouteShardsFor(orderIds);
+
+    std::vector<std::vector<size_t>> indexesByCacheShard(m_cacheShards.size());
+    std::vector<std::vector<std::string_view>> replacedByCacheShard(m_cacheShards.size());
+    for (size_t i = 0; i < orders.size(); i++) {
+        if (lastIndexByOrderId[orderIds[i]] != i) {
+            continue;
+        }
+
+        const auto cacheShard = cacheShardFor(orders[i].securityId());
+        auto& routeShard = routeShardFor(orderIds[i]);
+        auto [routeIt, inserted] = routeShard.tryAddRoute(orderIds[i], cacheShard);
+        if (!inserted && routeIt->second.cacheShard != cacheShard) {
+            replacedByCacheShard[routeIt->second.cacheShard].push_back(orderIds[i]);
+            routeIt->second.cacheShard = cacheShard;
+        }
+        indexesByCacheShard[cacheShard].push_back(i);
+    }
+
+    for (size_t cacheShard = 0; cacheShard < m_cacheShards.size(); cacheShard++) {
+        if (!replacedByCacheShard[cacheShard].empty()) {
+            m_cacheShards[cacheShard].cancelOrders(replacedByCacheShard[cacheShard]);
+        }
+    }
+    for (size_t cacheShard = 0; cacheShard < m_cacheShards.size(); cacheShard++) {
+        if (indexesByCacheShard[cacheShard].empty()) {
+            continue;
+        }
+        std::vector<Order> shardOrders;
+        shardOrders.reserve(indexesByCacheShard[cacheShard].size());
+        for (const auto i : indexesByCacheShard[cacheShard]) {
+            shardOrders.push_back(std::move(orders[i]));
+        }
+        m_cacheShards[cacheShard].addOrders(std::move(shardOrders));
+    }
+}
+
+void ShardedOrderCache::cancelOrder(std::string_view orderId) {
+    auto& routeShard = routeShardFor(orderId);
+
+    std::lock_guard<std::shared_mutex> lck(routeShard.mtx);
+
+    const auto& routeIt = routeShard.cacheShardByOrderId.find(orderId);
+    if (routeIt == routeShard.cacheShardByOrderId.end()) {
+        return;
+    }
+
+    m_cacheShards[routeIt->second.cacheShard].cancelOrder(orderId);
+    routeShard.cacheShardByOrderId.erase(routeIt);
+}
+
+void ShardedOrderCache::cancelOrders(const std::vector<std::string_view>& orderIds) {
+    const auto lcks = lockRouteShardsFor(orderIds);
+
+    std::vector<std::vector<std::string_view>> orderIdsByCacheShard(m_cacheShards.size());
+    for (const auto& orderId : orderIds) {
+        auto& routeShard = routeShardFor(orderId);
+        const auto& routeIt = routeShard.cacheShardByOrderId.find(orderId);
+        if (routeIt == routeShard.cacheShardByOrderId.end()) {
+            continue;
+        }
+        orderIdsByCacheShard[routeIt->second.cacheShard].push_back(orderId);
+        routeShard.cacheShardByOrderId.erase(routeIt);
+    }
+
+    for (size_t cacheShard = 0; cacheShard < m_cacheShards.size(); cacheShard++) {
+        if (!orderIdsByCacheShard[cacheShard].empty()) {
+            m_cacheShards[cacheShard].cancelOrders(orderIdsByCacheShard[cacheShard]);
+        }
+    }
+}
+
+void ShardedOrderCache::amendOrderQty(std::string_view orderId, unsigned int newQty) {
+    auto& routeShard = routeShardFor(orderId);
+
+    std::lock_guard<std::shared_mutex> lck(routeShard.mtx);
+
+    const auto& routeIt = routeShard.cacheShardByOrderId.find(orderId);
+    if (routeIt == routeShard.cacheShardByOrderId.end()) {
+        return;
+    }
+
+    unsigned int restingQty;
+    m_cacheShards[routeIt->second.cacheShard].amendOrderQty(orderId, newQty, &restingQty);
+    if (restingQty == 0) {
+        routeShard.cacheShardByOrderId.erase(routeIt);
+    }
+}
+
+void ShardedOrderCache::reduceOrderQty(std::string_view orderId, unsigned int delta) {
+    auto& routeShard = routeShardFor(orderId);
+
+    std::lock_guard<std::shared_mutex> lck(routeShard.mtx);
+
+    const auto& routeIt = routeShard.cacheShardByOrderId.find(orderId);
+    if (routeIt == routeShard.cacheShardByOrderId.end()) {
+        return;
+    }
+
+    unsigned int restingQty;
+    m_cacheShards[routeIt->second.cacheShard].reduceOrderQty(orderId, delta, &restingQty);
+    if (restingQty == 0) {
+        routeShard.cacheShardByOrderId.erase(routeIt);
+    }
+}
+
+void ShardedOrderCache::cancelOrdersForUser(std::string_view user) {
+    const auto lcks = lockAllRouteShards();
+
+    std::vector<std::string> cancelledOrderIds;
+    for (auto& cacheShard : m_cacheShards) {
+        cacheShard.cancelOrdersForUser(user, &cancelledOrderIds);
+    }
+    eraseRoutes(cancelledOrderIds);
+}
+
+void ShardedOrderCache::cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) {
+    const auto lcks = lockAllRouteShards();
+
+    std::vector<std::string> cancelledOrderIds;
+    m_cacheShards[cacheShardFor(securityId)].cancelOrdersForSecIdWithMinimumQty(securityId, minQty,
+                                                                              &cancelledOrderIds);
+    eraseRoutes(cancelledOrderIds);
+}
+
+unsigned int ShardedOrderCache::getMatchingSizeForSecurity(std::string_view securityId) {
+    // a security lives on a single shard, whose aggregates are always consistent
+    return m_cacheShards[cacheShardFor(securityId)].getMatchingSizeForSecurity(securityId);
+}
+
+std::vector<SecurityMatchingSize> ShardedOrderCache::getMatchingSizesForAllSecurities(size_t threadCount) const {
+    const auto lcks = lockAllRouteShardsShared();
+
+    std::vector<std::vector<SecurityMatchingSize>> sizesByCacheShard(m_cacheShards.size());
+    parallelFor(m_cacheShards.size(), 1, threadCount, [&](size_t begin, size_t end) {
+        for (size_t cacheShard = begin; cacheShard < end; cacheShard++) {
+            sizesByCacheShard[cacheShard] = m_cacheShards[cacheShard].getMatchingSizesForAllSecurities(1);
+        }
+    });
+
+    std::vector<SecurityMatchingSize> sizes;
+    for (const auto& shardSizes : sizesByCacheShard) {
+        sizes.insert(sizes.end(), shardSizes.begin(), shardSizes.end());
+    }
+    return sizes;
+}
+
+uint64_t ShardedOrderCache::getOpenQtyForUser(std::string_view user, std::string_view securityId,
+                                              OrderSide side) const {
+    // like matching sizes, open qty is per security, so a single shard holds all of it
+    return m_cacheShards[cacheShardFor(securityId)].getOpenQtyForUser(user, securityId, side);
+}
+
+uint64_t ShardedOrderCache::getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                                 OrderSide side) const {
+    return m_cacheShards[cacheShardFor(securityId)].getOpenQtyForCompany(company, securityId, side);
+}
+
+std::vector<Order> ShardedOrderCache::getAllOrders() const {
+    // every write holds a route lock, so holding them all shared gives a point-in-time view across shards
+    const auto lcks = lockAllRouteShardsShared();
+
+    std::vector<Order> orders;
+    for (const auto& cacheShard : m_cacheShards) {
+        auto shardOrders = cacheShard.getAllOrders();
+        orders.insert(orders.end(), std::make_move_iterator(shardOrders.begin()),
+                      std::make_move_iterator(shardOrders.end()));
+    }
+    return orders;
+}
+
+std::vector<Order> ShardedOrderCache::getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                                      unsigned int minQty) const {
+    return m_cacheShards[cacheShardFor(securityId)].getOrdersForSecIdWithMinimumQty(securityId, minQty);
+}
+
+size_t ShardedOrderCache::countOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) const {
+    return m_cacheShards[cacheShardFor(securityId)].countOrdersForSecIdWithMinimumQty(securityId, minQty);
+}
+
+void ShardedOrderCache::forEachOrder(const OrderVisitor& visitor, const OrderFilter& filter) const {
+    if (!filter.securityId.empty()) {
+        m_cacheShards[cacheShardFor(filter.securityId)].forEachOrder(visitor, filter);
+        return;
+    }
+
+    const auto lcks = lockAllRouteShardsShared();
+    for (const auto& cacheShard : m_cacheShards) {
+        cacheShard.forEachOrder(visitor, filter);
+    }
+}
+
+OrderSnapshot ShardedOrderCache::snapshot(const OrderFilter& filter) const {
+    if (!filter.securityId.empty()) {
+        return m_cacheShards[cacheShardFor(filter.securityId)].snapshot(filter);
+    }
+
+    const auto lcks = lockAllRouteShardsShared();
+    OrderSnapshot snapshot;
+    for (const auto& cacheShard : m_cacheShards) {
+        snapshot.append(cacheShard.snapshot(filter));
+    }
+    return snapshot;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FlatHashMap.h"
+#include "OrderCache.h"
+
+// Concurrent OrderCache: orders are partitioned by security id over independent OrderCache shards, each with its own
+// reader/writer lock, so matching queries on different securities run in parallel and queries never block each
+// other. A second set of shards, partitioned by order id, routes cancels to the cache shard holding the order.
+//
+// Lock order is always route shards (ascending) before cache shards. Single-order operations take one route lock;
+// mass cancels and getAllOrders take every route lock so they observe and leave a consistent state across shards.
+class ShardedOrderCache : public OrderCacheInterface {
+   public:
+    static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+    explicit ShardedOrderCache(size_t shardCount = DEFAULT_SHARD_COUNT);
+
+    void addOrder(Order order) override;
+    // groups the batch per shard, so each touched shard is locked once
+    void addOrders(std::vector<Order> orders) override;
+
+    void cancelOrder(std::string_view orderId) override;
+    void cancelOrders(const std::vector<std::string_view>& orderIds) override;
+
+    void cancelOrdersForUser(std::string_view user) override;
+
+    void amendOrderQty(std::string_view orderId, unsigned int newQty) override;
+    void reduceOrderQty(std::string_view orderId, unsigned int delta) override;
+
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) override;
+
+    unsigned int getMatchingSizeForSecurity(std::string_view securityId) override;
+    // same contract as OrderCache, with the shards spread over the threads; results are grouped by shard
+    std::vector<SecurityMatchingSize> getMatchingSizesForAllSecurities(size_t threadCount = 0) const;
+
+    // lock-free, as on OrderCache
+    uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const override;
+    uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                  OrderSide side) const override;
+
+    std::vector<Order> getAllOrders() const override;
+
+    std::vector<Order> getOrdersForSecIdWithMinimumQty(std::string_view securityId,
+                                                       unsigned int minQty) const override;
+    size_t countOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) const override;
+
+    // same contracts as OrderCache; both hold every route lock shared, so they see one point in time across shards
+    void forEachOrder(const OrderVisitor& visitor, const OrderFilter& filter = {}) const;
+    OrderSnapshot snapshot(const OrderFilter& filter = {}) const;
+
+   private:
+    struct Route {
+        std::unique_ptr<const std::string> orderId;
+        size_t cacheShard;
+    };
+
+    struct alignas(64) RouteShard {
+        mutable std::shared_mutex mtx;
+        // keys view the order id owned by their route, which stays put across rehashes, so cancels look up by
+        // string_view without building a std::string
+        FlatHashMap<std::string_view, Route> cacheShardByOrderId;
+
+        // returns the existing route instead if the order id already has one
+        std::pair<FlatHashMap<std::string_view, Route>::iterator, bool> tryAddRoute(std::string_view orderId,
+                                                                                   size_t cacheShard) {
+            const auto routeIt = cacheShardByOrderId.find(orderId);
+            if (routeIt != cacheShardByOrderId.end()) {
+                return {routeIt, false};
+            }
+            auto ownedOrderId = std::make_unique<const std::string>(orderId);
+            const std::string_view key = *ownedOrderId;
+            return cacheShardByOrderId.emplace(key, Route{std::move(ownedOrderId), cacheShard});
+        }
+    };
+
+    using RouteLocks = std::vector<std::unique_lock<std::shared_mutex>>;
+
+    size_t cacheShardFor(std::string_view securityId) const;
+    size_t routeShardIndexFor(std::string_view orderId) const;
+    RouteShard& routeShardFor(std::string_view orderId);
+
+    RouteLocks lockAllRouteShards();
+    std::vector<std::shared_lock<std::shared_mutex>> lockAllRouteShardsShared() const;
+    // locks the route shards of these order ids, in ascending order
+    RouteLocks lockRouteShardsFor(const std::vector<std::string_view>& orderIds);
+
+    void eraseRoutes(const std::vector<std::string>& orderIds);
+
+    std::vector<OrderCache> m_cacheShards;
+    std::vector<RouteShard> m_routeShards;
+};
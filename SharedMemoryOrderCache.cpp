@@ -0,0 +1,845 @@
+#include "SharedMemoryOrderCache.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[8] = "OCSHM02";
+// "no record" in an index link
+constexpr uint32_t NONE = UINT32_MAX;
+// hash slots hold a record index + 1, so a zero-filled table is empty
+constexpr uint32_t EMPTY_SLOT = 0;
+constexpr uint32_t TOMBSTONE = UINT32_MAX;
+constexpr size_t REGION_ALIGNMENT = 64;
+// a reader retrying this many times spins, then yields, and checks now and then that the writer is still alive
+constexpr uint32_t SPIN_ATTEMPTS = 64;
+constexpr uint32_t WRITER_CHECK_ATTEMPTS = 1024;
+
+[[noreturn]] void throwSystemError(const std::string& what, const std::string& name) {
+    throw std::runtime_error(what + " " + name + ": " + std::strerror(errno));
+}
+
+struct SymbolRecord {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    // list heads: the orders of this symbol as a user and as a security, and its company aggregates as a security
+    uint32_t firstOrderOfUser;
+    uint32_t firstOrderOfSecurity;
+    uint32_t firstCompanyAggregate;
+    uint32_t unused;
+    uint64_t totalQty[SIDE_SIZE];
+};
+
+struct OrderRecord {
+    char orderId[SharedMemoryOrderCache::MAX_ORDER_ID_LENGTH];
+    uint8_t orderIdLength;
+    OrderSide side;
+    bool live;
+    uint32_t qty;
+    uint32_t securityId;
+    uint32_t userId;
+    uint32_t companyId;
+    // doubly linked lists of the orders of a user and of a security; nextOfUser links the free list
+    uint32_t prevOfUser;
+    uint32_t nextOfUser;
+    uint32_t prevOfSecurity;
+    uint32_t nextOfSecurity;
+    uint32_t unused;
+
+    std::string_view orderIdView() const {
+        return {orderId, std::min<size_t>(orderIdLength, SharedMemoryOrderCache::MAX_ORDER_ID_LENGTH)};
+    }
+};
+static_assert(sizeof(OrderRecord) == 64, "an order record should fill one cache line");
+
+// Open qty of one user or company on one security
+struct AggregateRecord {
+    uint32_t securityId;
+    uint32_t ownerId;
+    uint32_t company;
+    uint32_t orderCount;
+    // list of the company aggregates of a security, which the matching size is computed from
+    uint32_t nextCompanyOfSecurity;
+    uint32_t unused;
+    uint64_t qty[SIDE_SIZE];
+};
+
+uint64_t alignRegion(uint64_t offset) { return (offset + REGION_ALIGNMENT - 1) & ~(REGION_ALIGNMENT - 1); }
+
+// power of two with room for twice the capacity, so probe chains stay short
+uint32_t slotCountFor(uint32_t capacity) {
+    uint32_t slots = 16;
+    while (slots < 2 * static_cast<uint64_t>(capacity)) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+// FNV-1a, which unlike std::hash is the same in every process whatever it was built with
+uint64_t hashOf(std::string_view value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : value) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t hashOf(uint32_t securityId, uint32_t ownerId, bool company) {
+    uint64_t key = (uint64_t{securityId} << 32 | ownerId) * 0x9e3779b97f4a7c15ULL;
+    return (key ^ (key >> 29)) + company;
+}
+
+void cpuPause() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+}  // namespace
+
+// Header at the start of the segment, followed by the regions it points to by offset. Every count below the
+// sequence is written by the writer only, and read under the seqlock.
+struct SharedMemoryCacheLayout {
+    char magic[sizeof(SEGMENT_MAGIC)];
+    SharedMemoryCacheLimits limits;
+    uint64_t segmentSize;
+
+    uint64_t symbolsOffset;
+    uint64_t symbolSlotsOffset;
+    uint64_t namesOffset;
+    uint64_t ordersOffset;
+    uint64_t orderSlotsOffset;
+    uint64_t aggregatesOffset;
+    uint64_t aggregateSlotsOffset;
+    uint32_t symbolSlotCount;
+    uint32_t orderSlotCount;
+    uint32_t aggregateSlotCount;
+    // process of the writer, so readers can tell a writer that died in the middle of a write from a slow one
+    int32_t writerPid;
+
+    // Seqlock: odd while the writer is changing the book. 0 until the segment is initialized.
+    alignas(64) std::atomic<uint64_t> sequence;
+    uint32_t symbolCount;
+    uint32_t nameBytes;
+    uint32_t orderCount;
+    // order records ever used; the ones below it that aren't live are on the free list
+    uint32_t orderHighWater;
+    uint32_t firstFreeOrder;
+    uint32_t orderTombstones;
+    uint32_t aggregateCount;
+
+    // lays the regions out after the header for these limits, returning the segment size
+    uint64_t layOut(const SharedMemoryCacheLimits& newLimits) {
+        limits = newLimits;
+        symbolSlotCount = slotCountFor(limits.maxSymbols);
+        orderSlotCount = slotCountFor(limits.maxOrders);
+        aggregateSlotCount = slotCountFor(limits.maxAggregates);
+
+        uint64_t offset = alignRegion(sizeof(SharedMemoryCacheLayout));
+        const auto place = [&](uint64_t& regionOffset, uint64_t size) {
+            regionOffset = offset;
+            offset = alignRegion(offset + size);
+        };
+        place(symbolsOffset, uint64_t{limits.maxSymbols} * sizeof(SymbolRecord));
+        place(symbolSlotsOffset, uint64_t{symbolSlotCount} * sizeof(uint32_t));
+        place(namesOffset, limits.maxSymbolBytes);
+        place(ordersOffset, uint64_t{limits.maxOrders} * sizeof(OrderRecord));
+        place(orderSlotsOffset, uint64_t{orderSlotCount} * sizeof(uint32_t));
+        place(aggregatesOffset, uint64_t{limits.maxAggregates} * sizeof(AggregateRecord));
+        place(aggregateSlotsOffset, uint64_t{aggregateSlotCount} * sizeof(uint32_t));
+        segmentSize = offset;
+        return segmentSize;
+    }
+
+    template <typename T>
+    T* region(uint64_t offset) {
+        return reinterpret_cast<T*>(reinterpret_cast<char*>(this) + offset);
+    }
+    template <typename T>
+    const T* region(uint64_t offset) const {
+        return reinterpret_cast<const T*>(reinterpret_cast<const char*>(this) + offset);
+    }
+
+    SymbolRecord* symbols() { return region<SymbolRecord>(symbolsOffset); }
+    const SymbolRecord* symbols() const { return region<SymbolRecord>(symbolsOffset); }
+    uint32_t* symbolSlots() { return region<uint32_t>(symbolSlotsOffset); }
+    const uint32_t* symbolSlots() const { return region<uint32_t>(symbolSlotsOffset); }
+    char* names() { return region<char>(namesOffset); }
+    const char* names() const { return region<char>(namesOffset); }
+    OrderRecord* orders() { return region<OrderRecord>(ordersOffset); }
+    const OrderRecord* orders() const { return region<OrderRecord>(ordersOffset); }
+    uint32_t* orderSlots() { return region<uint32_t>(orderSlotsOffset); }
+    const uint32_t* orderSlots() const { return region<uint32_t>(orderSlotsOffset); }
+    AggregateRecord* aggregates() { return region<AggregateRecord>(aggregatesOffset); }
+    const AggregateRecord* aggregates() const { return region<AggregateRecord>(aggregatesOffset); }
+    uint32_t* aggregateSlots() { return region<uint32_t>(aggregateSlotsOffset); }
+    const uint32_t* aggregateSlots() const { return region<uint32_t>(aggregateSlotsOffset); }
+
+    // Lookups, used by the writer and, under the seqlock, by readers. A reader overlapping a write may see torn
+    // records, so every index read from the segment is bounds-checked before use and a torn read only ever yields
+    // a wrong answer, which the seqlock then discards.
+
+    std::string_view symbolName(uint32_t symbolId) const {
+        const auto& symbol = symbols()[symbolId];
+        if (symbol.nameOffset > limits.maxSymbolBytes ||
+            symbol.nameLength > limits.maxSymbolBytes - symbol.nameOffset) {
+            return {};
+        }
+        return {names() + symbol.nameOffset, symbol.nameLength};
+    }
+
+    // returns NONE for a name never interned
+    uint32_t findSymbol(std::string_view name) const {
+        const uint32_t mask = symbolSlotCount - 1;
+        uint32_t slot = hashOf(name) & mask;
+        for (uint32_t probes = 0; probes < symbolSlotCount; probes++, slot = (slot + 1) & mask) {
+            const uint32_t value = symbolSlots()[slot];
+            if (value == EMPTY_SLOT || value > limits.maxSymbols) {
+                return NONE;
+            }
+            if (symbolName(value - 1) == name) {
+                return value - 1;
+            }
+        }
+        return NONE;
+    }
+
+    // returns NONE for an order id not resting; slotOut receives its slot in the order index
+    uint32_t findOrder(std::string_view orderId, uint32_t* slotOut = nullptr) const {
+        const uint32_t mask = orderSlotCount - 1;
+        uint32_t slot = hashOf(orderId) & mask;
+        for (uint32_t probes = 0; probes < orderSlotCount; probes++, slot = (slot + 1) & mask) {
+            const uint32_t value = orderSlots()[slot];
+            if (value == EMPTY_SLOT) {
+                return NONE;
+            }
+            if (value != TOMBSTONE && value <= limits.maxOrders && orders()[value - 1].orderIdView() == orderId) {
+                if (slotOut) {
+                    *slotOut = slot;
+                }
+                return value - 1;
+            }
+        }
+        return NONE;
+    }
+
+    // returns NONE if the owner never had an order on the security
+    uint32_t findAggregate(uint32_t securityId, uint32_t ownerId, bool company, uint32_t* slotOut = nullptr) const {
+        const uint32_t mask = aggregateSlotCount - 1;
+        uint32_t slot = hashOf(securityId, ownerId, company) & mask;
+        for (uint32_t probes = 0; probes < aggregateSlotCount; probes++, slot = (slot + 1) & mask) {
+            const uint32_t value = aggregateSlots()[slot];
+            if (value == EMPTY_SLOT || value > limits.maxAggregates) {
+                if (slotOut) {
+                    *slotOut = slot;
+                }
+                return NONE;
+            }
+            const auto& aggregate = aggregates()[value - 1];
+            if (aggregate.securityId == securityId && aggregate.ownerId == ownerId && aggregate.company == company) {
+                return value - 1;
+            }
+        }
+        return NONE;
+    }
+
+    // Runs read, which returns false if it saw an inconsistent book, until it ran without the writer overlapping it.
+    // Throws std::runtime_error once the writer died in the middle of a write, as the book will never be consistent.
+    template <typename Read>
+    void readConsistent(std::atomic<uint64_t>* retries, Read&& read) const {
+        for (uint32_t attempt = 1;; attempt++) {
+            const uint64_t before = sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                const bool consistent = read();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (consistent && sequence.load(std::memory_order_relaxed) == before) {
+                    return;
+                }
+            } else if (attempt % WRITER_CHECK_ATTEMPTS == 0 && !writerAlive()) {
+                throw std::runtime_error("the writer of the shared-memory order cache died in the middle of a write");
+            }
+            if (retries) {
+                retries->fetch_add(1, std::memory_order_relaxed);
+            }
+            if (attempt < SPIN_ATTEMPTS) {
+                cpuPause();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Signal 0 only checks that the process exists. A recycled pid reads as alive, and so does a writer in another
+    // pid namespace, where the reader waits for it like it would for a slow writer.
+    bool writerAlive() const { return ::kill(writerPid, 0) == 0 || errno != ESRCH; }
+
+    unsigned int matchingSize(std::string_view securityId, std::atomic<uint64_t>* retries) const {
+        uint64_t matchingSize = 0;
+        readConsistent(retries, [&] {
+            matchingSize = 0;
+            const uint32_t secId = findSymbol(securityId);
+            if (secId == NONE) {
+                return true;
+            }
+            // same formula as NettingEngine: empty company aggregates stay listed, and count as 0
+            const uint64_t totalBuy = symbols()[secId].totalQty[static_cast<size_t>(OrderSide::BUY)];
+            const uint64_t totalSell = symbols()[secId].totalQty[static_cast<size_t>(OrderSide::SELL)];
+            uint64_t largestCompanyQty = 0;
+            uint32_t steps = 0;
+            for (uint32_t a = symbols()[secId].firstCompanyAggregate; a != NONE;
+                 a = aggregates()[a].nextCompanyOfSecurity) {
+                if (a >= limits.maxAggregates || ++steps > limits.maxAggregates) {
+                    return false;
+                }
+                const auto& qty = aggregates()[a].qty;
+                largestCompanyQty = std::max(largestCompanyQty, qty[0] + qty[1]);
+            }
+            if (largestCompanyQty > totalBuy + totalSell) {
+                return false;
+            }
+            matchingSize = std::min({totalBuy, totalSell, totalBuy + totalSell - largestCompanyQty});
+            return true;
+        });
+        return static_cast<unsigned int>(std::min<uint64_t>(matchingSize, std::numeric_limits<unsigned int>::max()));
+    }
+
+    uint64_t openQty(std::string_view owner, std::string_view securityId, OrderSide side, bool company,
+                     std::atomic<uint64_t>* retries) const {
+        uint64_t qty = 0;
+        readConsistent(retries, [&] {
+            qty = 0;
+            const uint32_t ownerId = findSymbol(owner);
+            const uint32_t secId = findSymbol(securityId);
+            if (ownerId == NONE || secId == NONE) {
+                return true;
+            }
+            const uint32_t aggregate = findAggregate(secId, ownerId, company);
+            if (aggregate != NONE) {
+                qty = aggregates()[aggregate].qty[static_cast<size_t>(side)];
+            }
+            return true;
+        });
+        return qty;
+    }
+
+    std::vector<Order> allOrders(std::atomic<uint64_t>* retries) const {
+        // Symbol names are never changed once interned, so views of them stay valid after the read. Order records
+        // are reused once cancelled, so the order id is copied under the seqlock instead.
+        struct OrderFields {
+            std::array<char, SharedMemoryOrderCache::MAX_ORDER_ID_LENGTH> orderId;
+            size_t orderIdLength;
+            std::string_view securityId;
+            OrderSide side;
+            unsigned int qty;
+            std::string_view user;
+            std::string_view company;
+        };
+        std::vector<OrderFields> fields;
+        readConsistent(retries, [&] {
+            fields.clear();
+            const uint32_t highWater = std::min(orderHighWater, limits.maxOrders);
+            fields.reserve(std::min(orderCount, highWater));
+            for (uint32_t i = 0; i < highWater; i++) {
+                const auto& order = orders()[i];
+                if (!order.live) {
+                    continue;
+                }
+                if (order.securityId >= limits.maxSymbols || order.userId >= limits.maxSymbols ||
+                    order.companyId >= limits.maxSymbols) {
+                    return false;
+                }
+                auto& orderFields = fields.emplace_back();
+                const auto orderId = order.orderIdView();
+                std::memcpy(orderFields.orderId.data(), orderId.data(), orderId.size());
+                orderFields.orderIdLength = orderId.size();
+                orderFields.securityId = symbolName(order.securityId);
+                orderFields.side = order.side;
+                orderFields.qty = order.qty;
+                orderFields.user = symbolName(order.userId);
+                orderFields.company = symbolName(order.companyId);
+            }
+            return true;
+        });
+
+        std::vector<Order> orders;
+        orders.reserve(fields.size());
+        for (const auto& order : fields) {
+            orders.emplace_back(std::string(order.orderId.data(), order.orderIdLength), std::string(order.securityId),
+                                OrderCache::sideName(order.side), order.qty, std::string(order.user),
+                                std::string(order.company));
+        }
+        return orders;
+    }
+};
+
+SharedMemorySegment SharedMemorySegment::create(const std::string& name, size_t size) {
+    // a segment left behind by a writer that died is replaced; readers still mapping it are unaffected
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        throwSystemError("cannot create shared memory", name);
+    }
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throwSystemError("cannot size shared memory", name);
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throwSystemError("cannot map shared memory", name);
+    }
+    return SharedMemorySegment(name, static_cast<char*>(data), size);
+}
+
+SharedMemorySegment SharedMemorySegment::open(const std::string& name) {
+    const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throwSystemError("cannot open shared memory", name);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throwSystemError("cannot stat shared memory", name);
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(SharedMemoryCacheLayout)) {
+        ::close(fd);
+        throw std::runtime_error("shared memory " + name + " is not an order cache");
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throwSystemError("cannot map shared memory", name);
+    }
+    return SharedMemorySegment(name, static_cast<char*>(data), size);
+}
+
+SharedMemorySegment::SharedMemorySegment(SharedMemorySegment&& other) noexcept
+    : m_name(std::move(other.m_name)), m_data(std::exchange(other.m_data, nullptr)), m_size(other.m_size) {}
+
+SharedMemorySegment::~SharedMemorySegment() {
+    if (m_data) {
+        ::munmap(m_data, m_size);
+    }
+}
+
+// Makes the writes of its scope one step of the seqlock: readers that overlap it retry
+class SharedMemoryOrderCache::WriteSection {
+   public:
+    explicit WriteSection(SharedMemoryCacheLayout& layout)
+        : m_sequence(layout.sequence), m_before(m_sequence.load(std::memory_order_relaxed)) {
+        m_sequence.store(m_before + 1, std::memory_order_relaxed);
+        // the odd sequence is visible before any write of the section
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    ~WriteSection() { m_sequence.store(m_before + 2, std::memory_order_release); }
+
+   private:
+    std::atomic<uint64_t>& m_sequence;
+    const uint64_t m_before;
+};
+
+namespace {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the seqlock sequence must work across processes");
+
+uint64_t segmentSizeFor(const SharedMemoryCacheLimits& limits) {
+    if (limits.maxOrders == 0 || limits.maxSymbols == 0 || limits.maxAggregates == 0 ||
+        limits.maxOrders >= TOMBSTONE || limits.maxSymbols >= TOMBSTONE || limits.maxAggregates >= TOMBSTONE) {
+        throw std::invalid_argument("shared-memory cache limits must be between 1 and 2^32 - 2");
+    }
+    SharedMemoryCacheLayout layout{};
+    return layout.layOut(limits);
+}
+
+SharedMemoryCacheLayout* initializeLayout(const SharedMemorySegment& segment, const SharedMemoryCacheLimits& limits) {
+    auto* layout = new (segment.data()) SharedMemoryCacheLayout{};
+    std::memcpy(layout->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    layout->layOut(limits);
+    for (uint32_t i = 0; i < limits.maxSymbols; i++) {
+        layout->symbols()[i] = SymbolRecord{0, 0, NONE, NONE, NONE, 0, {0, 0}};
+    }
+    layout->firstFreeOrder = NONE;
+    layout->writerPid = ::getpid();
+    // publishes the initialized segment to readers
+    layout->sequence.store(2, std::memory_order_release);
+    return layout;
+}
+
+const SharedMemoryCacheLayout* validateLayout(const SharedMemorySegment& segment) {
+    const auto* layout = reinterpret_cast<const SharedMemoryCacheLayout*>(segment.data());
+    if (layout->sequence.load(std::memory_order_acquire) == 0 ||
+        std::memcmp(layout->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+        layout->segmentSize > segment.size()) {
+        throw std::runtime_error("shared memory " + segment.name() + " is not an order cache");
+    }
+    return layout;
+}
+
+OrderSide validateOrder(const Order& order) {
+    if (order.orderId().size() > SharedMemoryOrderCache::MAX_ORDER_ID_LENGTH) {
+        throw std::invalid_argument("order id longer than " +
+                                    std::to_string(SharedMemoryOrderCache::MAX_ORDER_ID_LENGTH) +
+                                    " bytes: " + order.orderId());
+    }
+    return OrderCache::toOrderSide(order.side());
+}
+
+// moves an order's open qty from oldQty to newQty in its aggregates and its security's totals
+void changeOpenQty(SharedMemoryCacheLayout& layout, const OrderRecord& order, uint64_t oldQty, uint64_t newQty) {
+    const auto side = static_cast<size_t>(order.side);
+    for (const bool company : {false, true}) {
+        auto& qty = layout.aggregates()[layout.findAggregate(order.securityId, company ? order.companyId : order.userId,
+                                                             company)]
+                        .qty[side];
+        qty = qty - oldQty + newQty;
+    }
+    auto& totalQty = layout.symbols()[order.securityId].totalQty[side];
+    totalQty = totalQty - oldQty + newQty;
+}
+
+}  // namespace
+
+SharedMemoryOrderCache::SharedMemoryOrderCache(const std::string& name, const SharedMemoryCacheLimits& limits)
+    : m_segment(SharedMemorySegment::create(name, segmentSizeFor(limits))),
+      m_layout(initializeLayout(m_segment, limits)) {}
+
+SharedMemoryOrderCache::~SharedMemoryOrderCache() { ::shm_unlink(m_segment.name().c_str()); }
+
+uint32_t SharedMemoryOrderCache::internLocked(std::string_view name) {
+    const uint32_t existing = m_layout->findSymbol(name);
+    if (existing != NONE) {
+        return existing;
+    }
+    if (m_layout->symbolCount == m_layout->limits.maxSymbols ||
+        name.size() > m_layout->limits.maxSymbolBytes - m_layout->nameBytes) {
+        throw std::length_error("shared-memory cache " + m_segment.name() + " has no room for symbol " +
+                                std::string(name));
+    }
+
+    const uint32_t symbolId = m_layout->symbolCount++;
+    std::memcpy(m_layout->names() + m_layout->nameBytes, name.data(), name.size());
+    auto& symbol = m_layout->symbols()[symbolId];
+    symbol.nameOffset = m_layout->nameBytes;
+    symbol.nameLength = static_cast<uint32_t>(name.size());
+    m_layout->nameBytes += static_cast<uint32_t>(name.size());
+
+    const uint32_t mask = m_layout->symbolSlotCount - 1;
+    uint32_t slot = hashOf(name) & mask;
+    while (m_layout->symbolSlots()[slot] != EMPTY_SLOT) {
+        slot = (slot + 1) & mask;
+    }
+    m_layout->symbolSlots()[slot] = symbolId + 1;
+    return symbolId;
+}
+
+uint32_t SharedMemoryOrderCache::aggregateLocked(uint32_t securityId, uint32_t ownerId, bool company) {
+    uint32_t slot = 0;
+    const uint32_t existing = m_layout->findAggregate(securityId, ownerId, company, &slot);
+    if (existing != NONE) {
+        return existing;
+    }
+    if (m_layout->aggregateCount == m_layout->limits.maxAggregates) {
+        throw std::length_error("shared-memory cache " + m_segment.name() + " has no room for another aggregate");
+    }
+
+    const uint32_t aggregateId = m_layout->aggregateCount++;
+    auto& aggregate = m_layout->aggregates()[aggregateId];
+    aggregate = AggregateRecord{securityId, ownerId, company, 0, NONE, 0, {0, 0}};
+    if (company) {
+        auto& security = m_layout->symbols()[securityId];
+        aggregate.nextCompanyOfSecurity = security.firstCompanyAggregate;
+        security.firstCompanyAggregate = aggregateId;
+    }
+    m_layout->aggregateSlots()[slot] = aggregateId + 1;
+    return aggregateId;
+}
+
+void SharedMemoryOrderCache::addOrderLocked(const Order& order, OrderSide side) {
+    const uint32_t existing = m_layout->findOrder(order.orderId());
+    if (existing == NONE && m_layout->orderCount == m_layout->limits.maxOrders) {
+        throw std::length_error("shared-memory cache " + m_segment.name() + " has no room for order " +
+                                order.orderId());
+    }
+    // everything that can run out of room is reserved before the book changes; an unused symbol or aggregate is
+    // harmless
+    const uint32_t securityId = internLocked(order.securityId());
+    const uint32_t userId = internLocked(order.user());
+    const uint32_t companyId = internLocked(order.company());
+    const uint32_t userAggregate = aggregateLocked(securityId, userId, false);
+    const uint32_t companyAggregate = aggregateLocked(securityId, companyId, true);
+
+    // re-adding an existing order id replaces the resting order
+    if (existing != NONE) {
+        cancelLocked(existing);
+    }
+
+    uint32_t index = m_layout->firstFreeOrder;
+    if (index != NONE) {
+        m_layout->firstFreeOrder = m_layout->orders()[index].nextOfUser;
+    } else {
+        index = m_layout->orderHighWater++;
+    }
+    auto& record = m_layout->orders()[index];
+    std::memcpy(record.orderId, order.orderId().data(), order.orderId().size());
+    record.orderIdLength = static_cast<uint8_t>(order.orderId().size());
+    record.side = side;
+    record.qty = order.qty();
+    record.securityId = securityId;
+    record.userId = userId;
+    record.companyId = companyId;
+
+    auto* orders = m_layout->orders();
+    auto& user = m_layout->symbols()[userId];
+    record.prevOfUser = NONE;
+    record.nextOfUser = user.firstOrderOfUser;
+    if (record.nextOfUser != NONE) {
+        orders[record.nextOfUser].prevOfUser = index;
+    }
+    user.firstOrderOfUser = index;
+    auto& security = m_layout->symbols()[securityId];
+    record.prevOfSecurity = NONE;
+    record.nextOfSecurity = security.firstOrderOfSecurity;
+    if (record.nextOfSecurity != NONE) {
+        orders[record.nextOfSecurity].prevOfSecurity = index;
+    }
+    security.firstOrderOfSecurity = index;
+    record.live = true;
+
+    m_layout->aggregates()[userAggregate].orderCount++;
+    m_layout->aggregates()[companyAggregate].orderCount++;
+    changeOpenQty(*m_layout, record, 0, record.qty);
+
+    const uint32_t mask = m_layout->orderSlotCount - 1;
+    uint32_t slot = hashOf(order.orderId()) & mask;
+    while (m_layout->orderSlots()[slot] != EMPTY_SLOT && m_layout->orderSlots()[slot] != TOMBSTONE) {
+        slot = (slot + 1) & mask;
+    }
+    if (m_layout->orderSlots()[slot] == TOMBSTONE) {
+        m_layout->orderTombstones--;
+    }
+    m_layout->orderSlots()[slot] = index + 1;
+    m_layout->orderCount++;
+}
+
+void SharedMemoryOrderCache::cancelLocked(uint32_t order) {
+    auto* orders = m_layout->orders();
+    auto& record = orders[order];
+
+    if (record.prevOfUser != NONE) {
+        orders[record.prevOfUser].nextOfUser = record.nextOfUser;
+    } else {
+        m_layout->symbols()[record.userId].firstOrderOfUser = record.nextOfUser;
+    }
+    if (record.nextOfUser != NONE) {
+        orders[record.nextOfUser].prevOfUser = record.prevOfUser;
+    }
+    if (record.prevOfSecurity != NONE) {
+        orders[record.prevOfSecurity].nextOfSecurity = record.nextOfSecurity;
+    } else {
+        m_layout->symbols()[record.securityId].firstOrderOfSecurity = record.nextOfSecurity;
+    }
+    if (record.nextOfSecurity != NONE) {
+        orders[record.nextOfSecurity].prevOfSecurity = record.prevOfSecurity;
+    }
+
+    changeOpenQty(*m_layout, record, record.qty, 0);
+    m_layout->aggregates()[m_layout->findAggregate(record.securityId, record.userId, false)].orderCount--;
+    m_layout->aggregates()[m_layout->findAggregate(record.securityId, record.companyId, true)].orderCount--;
+
+    record.live = false;
+    eraseFromOrderIndexLocked(order);
+    record.nextOfUser = m_layout->firstFreeOrder;
+    m_layout->firstFreeOrder = order;
+    m_layout->orderCount--;
+}
+
+void SharedMemoryOrderCache::setOrderQtyLocked(uint32_t order, unsigned int newQty) {
+    auto& record = m_layout->orders()[order];
+    if (newQty == 0) {
+        cancelLocked(order);
+        return;
+    }
+    changeOpenQty(*m_layout, record, record.qty, newQty);
+    record.qty = newQty;
+}
+
+void SharedMemoryOrderCache::eraseFromOrderIndexLocked(uint32_t order) {
+    uint32_t slot = 0;
+    m_layout->findOrder(m_layout->orders()[order].orderIdView(), &slot);
+    m_layout->orderSlots()[slot] = TOMBSTONE;
+    m_layout->orderTombstones++;
+    // keeps probe chains short; rebuilding is linear, but only due after as many cancels as there are slots / 4
+    if (m_layout->orderCount + m_layout->orderTombstones > m_layout->orderSlotCount / 4 * 3) {
+        rebuildOrderIndexLocked();
+    }
+}
+
+void SharedMemoryOrderCache::rebuildOrderIndexLocked() {
+    auto* slots = m_layout->orderSlots();
+    std::fill(slots, slots + m_layout->orderSlotCount, EMPTY_SLOT);
+    m_layout->orderTombstones = 0;
+
+    const uint32_t mask = m_layout->orderSlotCount - 1;
+    for (uint32_t i = 0; i < m_layout->orderHighWater; i++) {
+        const auto& record = m_layout->orders()[i];
+        if (!record.live) {
+            continue;
+        }
+        uint32_t slot = hashOf(record.orderIdView()) & mask;
+        while (slots[slot] != EMPTY_SLOT) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = i + 1;
+    }
+}
+
+void SharedMemoryOrderCache::addOrder(Order order) {
+    const auto side = validateOrder(order);
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    WriteSection section(*m_layout);
+    addOrderLocked(order, side);
+}
+
+void SharedMemoryOrderCache::addOrders(std::vector<Order> orders) {
+    std::vector<OrderSide> sides;
+    sides.reserve(orders.size());
+    for (const auto& order : orders) {
+        sides.push_back(validateOrder(order));
+    }
+
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    WriteSection section(*m_layout);
+    for (size_t i = 0; i < orders.size(); i++) {
+        addOrderLocked(orders[i], sides[i]);
+    }
+}
+
+void SharedMemoryOrderCache::cancelOrder(std::string_view orderId) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    const uint32_t order = m_layout->findOrder(orderId);
+    if (order == NONE) {
+        return;
+    }
+    WriteSection section(*m_layout);
+    cancelLocked(order);
+}
+
+void SharedMemoryOrderCache::cancelOrders(const std::vector<std::string_view>& orderIds) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    WriteSection section(*m_layout);
+    for (const auto& orderId : orderIds) {
+        const uint32_t order = m_layout->findOrder(orderId);
+        if (order != NONE) {
+            cancelLocked(order);
+        }
+    }
+}
+
+void SharedMemoryOrderCache::cancelOrdersForUser(std::string_view user) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    const uint32_t userId = m_layout->findSymbol(user);
+    if (userId == NONE) {
+        return;
+    }
+    WriteSection section(*m_layout);
+    uint32_t order = m_layout->symbols()[userId].firstOrderOfUser;
+    while (order != NONE) {
+        const uint32_t next = m_layout->orders()[order].nextOfUser;
+        cancelLocked(order);
+        order = next;
+    }
+}
+
+void SharedMemoryOrderCache::cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    const uint32_t secId = m_layout->findSymbol(securityId);
+    if (secId == NONE) {
+        return;
+    }
+    WriteSection section(*m_layout);
+    uint32_t order = m_layout->symbols()[secId].firstOrderOfSecurity;
+    while (order != NONE) {
+        const auto& record = m_layout->orders()[order];
+        const uint32_t next = record.nextOfSecurity;
+        if (record.qty >= minQty) {
+            cancelLocked(order);
+        }
+        order = next;
+    }
+}
+
+void SharedMemoryOrderCache::amendOrderQty(std::string_view orderId, unsigned int newQty) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    const uint32_t order = m_layout->findOrder(orderId);
+    if (order == NONE) {
+        return;
+    }
+    WriteSection section(*m_layout);
+    setOrderQtyLocked(order, newQty);
+}
+
+void SharedMemoryOrderCache::reduceOrderQty(std::string_view orderId, unsigned int delta) {
+    std::lock_guard<std::mutex> lck(m_writeMtx);
+    const uint32_t order = m_layout->findOrder(orderId);
+    if (order == NONE) {
+        return;
+    }
+    WriteSection section(*m_layout);
+    const unsigned int qty = m_layout->orders()[order].qty;
+    setOrderQtyLocked(order, delta < qty ? qty - delta : 0);
+}
+
+unsigned int SharedMemoryOrderCache::getMatchingSizeForSecurity(std::string_view securityId) {
+    return m_layout->matchingSize(securityId, nullptr);
+}
+
+std::vector<Order> SharedMemoryOrderCache::getAllOrders() const { return m_layout->allOrders(nullptr); }
+
+uint64_t SharedMemoryOrderCache::getOpenQtyForUser(std::string_view user, std::string_view securityId,
+                                                   OrderSide side) const {
+    return m_layout->openQty(user, securityId, side, false, nullptr);
+}
+
+uint64_t SharedMemoryOrderCache::getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                                      OrderSide side) const {
+    return m_layout->openQty(company, securityId, side, true, nullptr);
+}
+
+SharedMemoryOrderCacheReader::SharedMemoryOrderCacheReader(const std::string& name)
+    : m_segment(SharedMemorySegment::open(name)), m_layout(validateLayout(m_segment)) {}
+
+unsigned int SharedMemoryOrderCacheReader::getMatchingSizeForSecurity(std::string_view securityId) const {
+    return m_layout->matchingSize(securityId, &m_retries);
+}
+
+std::vector<Order> SharedMemoryOrderCacheReader::getAllOrders() const { return m_layout->allOrders(&m_retries); }
+
+uint64_t SharedMemoryOrderCacheReader::getOpenQtyForUser(std::string_view user, std::string_view securityId,
+                                                         OrderSide side) const {
+    return m_layout->openQty(user, securityId, side, false, &m_retries);
+}
+
+uint64_t SharedMemoryOrderCacheReader::getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                                            OrderSide side) const {
+    return m_layout->openQty(company, securityId, side, true, &m_retries);
+}
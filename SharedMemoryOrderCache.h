@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "OrderCache.h"
+
+// Capacity of a shared-memory cache, fixed when its segment is created
+struct SharedMemoryCacheLimits {
+    uint32_t maxOrders = 1 << 20;
+    // distinct users, companies and security ids together
+    uint32_t maxSymbols = 1 << 16;
+    // bytes of all the symbol names together
+    uint32_t maxSymbolBytes = 1 << 22;
+    // distinct (security id, user) and (security id, company) pairs together
+    uint32_t maxAggregates = 1 << 20;
+};
+
+// header at the start of the segment, see SharedMemoryOrderCache.cpp
+struct SharedMemoryCacheLayout;
+
+// A named POSIX shared-memory segment mapped into this process, unmapped on destruction
+class SharedMemorySegment {
+   public:
+    // creates the segment, replacing any segment of that name, zero-filled and mapped read-write
+    static SharedMemorySegment create(const std::string& name, size_t size);
+    // maps an existing segment read-only
+    static SharedMemorySegment open(const std::string& name);
+
+    SharedMemorySegment(SharedMemorySegment&& other) noexcept;
+    SharedMemorySegment& operator=(SharedMemorySegment&&) = delete;
+    ~SharedMemorySegment();
+
+    char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const std::string& name() const { return m_name; }
+
+   private:
+    SharedMemorySegment(std::string name, char* data, size_t size)
+        : m_name(std::move(name)), m_data(data), m_size(size) {}
+
+    std::string m_name;
+    char* m_data;
+    size_t m_size;
+};
+
+// Order cache whose storage and indexes live in a POSIX shared-memory segment, so one writer process can serve any
+// number of reader processes (see SharedMemoryOrderCacheReader) without each of them keeping its own copy.
+//
+// Everything in the segment is a fixed-capacity array, and records link to each other by 32-bit index instead of by
+// pointer, so the segment means the same at any address. Symbols and (security, owner) aggregates are interned for
+// the lifetime of the segment, like in OrderCache. Writes are applied under a seqlock: readers never block the writer,
+// and retry a read the writer overlapped with. Reads from the writer process go through the same seqlock.
+class SharedMemoryOrderCache final : public OrderCacheInterface {
+   public:
+    static constexpr size_t MAX_ORDER_ID_LENGTH = 24;
+
+    // Creates segment name (a POSIX shared-memory name such as "/orders"), replacing any segment of that name. The
+    // segment is unlinked on destruction; readers that still have it mapped keep reading the last state.
+    explicit SharedMemoryOrderCache(const std::string& name, const SharedMemoryCacheLimits& limits = {});
+    ~SharedMemoryOrderCache() override;
+
+    // Throws like OrderCache for a bad side, std::invalid_argument for an order id longer than MAX_ORDER_ID_LENGTH
+    // and std::length_error when the segment is full. A rejected order leaves the cache unchanged.
+    void addOrder(Order order) override;
+    // the whole batch is validated first, then applied as one write; if the segment fills up, the orders before
+    // the one that didn't fit stay
+    void addOrders(std::vector<Order> orders) override;
+
+    void cancelOrder(std::string_view orderId) override;
+    void cancelOrders(const std::vector<std::string_view>& orderIds) override;
+
+    void cancelOrdersForUser(std::string_view user) override;
+
+    void cancelOrdersForSecIdWithMinimumQty(std::string_view securityId, unsigned int minQty) override;
+
+    // in place, like OrderCache
+    void amendOrderQty(std::string_view orderId, unsigned int newQty) override;
+    void reduceOrderQty(std::string_view orderId, unsigned int delta) override;
+
+    unsigned int getMatchingSizeForSecurity(std::string_view securityId) override;
+    std::vector<Order> getAllOrders() const override;
+    uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const override;
+    uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId,
+                                  OrderSide side) const override;
+
+    const std::string& name() const { return m_segment.name(); }
+
+   private:
+    class WriteSection;
+
+    void addOrderLocked(const Order& order, OrderSide side);
+    uint32_t internLocked(std::string_view name);
+    uint32_t aggregateLocked(uint32_t securityId, uint32_t ownerId, bool company);
+    void cancelLocked(uint32_t order);
+    void setOrderQtyLocked(uint32_t order, unsigned int newQty);
+    void eraseFromOrderIndexLocked(uint32_t order);
+    void rebuildOrderIndexLocked();
+
+    SharedMemorySegment m_segment;
+    SharedMemoryCacheLayout* m_layout;
+    // serializes the writers of this process
+    std::mutex m_writeMtx;
+};
+
+// Read-only view of the segment of a SharedMemoryOrderCache, usually from another process. Queries take no lock:
+// each one reads under the writer's seqlock, and retries when the writer changed the book meanwhile, spinning briefly
+// and then yielding. A query throws std::runtime_error if the writer process died in the middle of a write.
+class SharedMemoryOrderCacheReader {
+   public:
+    // throws std::runtime_error if the segment doesn't exist or wasn't created by a SharedMemoryOrderCache
+    explicit SharedMemoryOrderCacheReader(const std::string& name);
+
+    unsigned int getMatchingSizeForSecurity(std::string_view securityId) const;
+    std::vector<Order> getAllOrders() const;
+    uint64_t getOpenQtyForUser(std::string_view user, std::string_view securityId, OrderSide side) const;
+    uint64_t getOpenQtyForCompany(std::string_view company, std::string_view securityId, OrderSide side) const;
+
+    // reads retried because the writer overlapped them, since the reader was opened
+    uint64_t retries() const { return m_retries.load(std::memory_order_relaxed); }
+
+   private:
+    SharedMemorySegment m_segment;
+    const SharedMemoryCacheLayout* m_layout;
+    mutable std::atomic<uint64_t> m_retries{0};
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+#include "FlatHashMap.h"
+
+using SymbolId = uint32_t;
+
+// Interns strings (users, companies, security ids) into dense integer ids. Ids are never recycled, so an id stays
+// valid for the lifetime of the table and can be used to index flat per-symbol arrays.
+class SymbolTable {
+   public:
+    // only allocates the first time a name is seen
+    SymbolId intern(std::string_view name) {
+        const auto it = m_ids.find(name);
+        if (it != m_ids.end()) {
+            return it->second;
+        }
+        const auto id = static_cast<SymbolId>(m_names.size());
+        m_ids.emplace(m_names.emplace_back(name), id);
+        return id;
+    }
+
+    // returns false if the name was never interned
+    bool find(std::string_view name, SymbolId& id) const {
+        const auto it = m_ids.find(name);
+        if (it == m_ids.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    const std::string& name(SymbolId id) const { return m_names[id]; }
+
+    size_t size() const { return m_names.size(); }
+
+   private:
+    // keys view the names below, which a deque never moves, so lookups by string_view don't allocate
+    FlatHashMap<std::string_view, SymbolId> m_ids;
+    std::deque<std::string> m_names;
+};